@@ -0,0 +1,126 @@
+#pragma once
+//hardware abstraction layer
+//Everything the sniffer needs from the board goes through here: time source, RX edge source,
+//LIN byte source, host serial port (commands and output) and persistent storage.
+//On the Due these map directly to the Arduino core, on the host (env:native) to a simulated bus.
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "DueFlashStorage.h"
+
+#define LIN_CHANNELS 3 //number of LIN ports, see hal::lin_port
+
+//serial port used for communicating with a computer. A write that does not fit the transmit buffer waits for room
+//like Serial does, but calls waiting meanwhile - the buses are serviced while a long command reply goes out
+class host_port : public Print
+{
+public:
+    void (*waiting)() = nullptr;
+
+    void begin(unsigned long baud) { Serial.begin(baud); }
+    int available() { return Serial.available(); }
+    int read() { return Serial.read(); }
+    void flush() { Serial.flush(); }
+    int availableForWrite() { return Serial.availableForWrite(); }
+    size_t write(uint8_t c)
+    {
+        while (Serial.availableForWrite() <= 0)
+            if (waiting)
+                waiting();
+        return Serial.write(c);
+    }
+    using Print::write;
+};
+host_port HostSerial;
+
+namespace hal
+{
+    DueFlashStorage flash;
+
+    //LIN ports: the serial port, its USART and the pin of its RX line (also used for the edge interrupt).
+    //They need to match!
+    template <uint8_t CHANNEL>
+    struct lin_port;
+    template <>
+    struct lin_port<1>
+    {
+        static USARTClass &serial() { return Serial1; }
+        static Usart *usart() { return USART0; }
+        static const uint32_t rx_pin = 19;
+    };
+    template <>
+    struct lin_port<2>
+    {
+        static USARTClass &serial() { return Serial2; }
+        static Usart *usart() { return USART1; }
+        static const uint32_t rx_pin = 17;
+    };
+    template <>
+    struct lin_port<3>
+    {
+        static USARTClass &serial() { return Serial3; }
+        static Usart *usart() { return USART3; }
+        static const uint32_t rx_pin = 15;
+    };
+
+    //time source: microseconds counted by timer channel TC0/1 in hardware. Cheaper and steadier than micros(),
+    //which reads SysTick with interrupts disabled. Channel 0 divides MCK/2 down to 1 MHz on TIOA0 (internal only),
+    //channel 1 counts its periods. Wraps every 71 minutes like micros()
+    inline void timestampInit()
+    {
+        pmc_enable_periph_clk(ID_TC0);
+        pmc_enable_periph_clk(ID_TC1);
+        //the counter runs from 0 to RC, one period is RC + 1 clocks
+        TC_Configure(TC0, 0, TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_ACPA_SET | TC_CMR_ACPC_CLEAR);
+        TC_SetRA(TC0, 0, VARIANT_MCK / 2 / 1000000 / 2);
+        TC_SetRC(TC0, 0, VARIANT_MCK / 2 / 1000000 - 1);
+        TC0->TC_BMR = (TC0->TC_BMR & ~TC_BMR_TC1XC1S_Msk) | TC_BMR_TC1XC1S_TIOA0;
+        TC_Configure(TC0, 1, TC_CMR_TCCLKS_XC1);
+        TC_Start(TC0, 1);
+        TC_Start(TC0, 0);
+    }
+    inline unsigned long timestamp() { return TC0->TC_CHANNEL[1].TC_CV; }
+
+    //profiling: the CPU cycle counter of the Cortex-M3 (DWT), one read costs a single load
+    inline uint32_t cyclesPerMicrosecond() { return VARIANT_MCK / 1000000; }
+    inline void cyclesInit()
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    inline uint32_t cycles() { return DWT->CYCCNT; }
+
+    //RX edge source
+    template <uint8_t CHANNEL>
+    inline void rxInit() { pinMode(lin_port<CHANNEL>::rx_pin, INPUT_PULLUP); }
+    template <uint8_t CHANNEL>
+    inline bool rxLevel() { return digitalRead(lin_port<CHANNEL>::rx_pin); }
+    template <uint8_t CHANNEL>
+    inline void attachRxEdge(void (*handler)()) { attachInterrupt(digitalPinToInterrupt(lin_port<CHANNEL>::rx_pin), handler, CHANGE); }
+    template <uint8_t CHANNEL>
+    inline void detachRxEdge() { detachInterrupt(digitalPinToInterrupt(lin_port<CHANNEL>::rx_pin)); }
+
+    //LIN byte source
+    template <uint8_t CHANNEL>
+    inline void linBegin(long baud) { lin_port<CHANNEL>::serial().begin(baud, SERIAL_8N1); }
+    template <uint8_t CHANNEL>
+    inline void linEnd() { lin_port<CHANNEL>::serial().end(); }
+    //changes the baudrate without resetting the USART (same divider as UARTClass::init), a byte on its way is lost
+    template <uint8_t CHANNEL>
+    inline void linSetBaud(long baud) { lin_port<CHANNEL>::usart()->US_BRGR = (SystemCoreClock / baud) >> 4; }
+    template <uint8_t CHANNEL>
+    inline int linAvailable() { return lin_port<CHANNEL>::serial().available(); }
+    template <uint8_t CHANNEL>
+    inline uint8_t linRead() { return lin_port<CHANNEL>::serial().read(); }
+
+    //persistent storage
+    inline uint8_t storageRead(uint32_t address) { return flash.read(address); }
+    inline bool storageWrite(uint32_t address, uint8_t *data, uint32_t length) { return flash.write(address, data, length); }
+
+    //probe for the host build, called with every frame (sync + pid + data + chk) passed on for reporting
+    inline void frameReceived(uint8_t channel, const uint8_t *bytes, uint8_t count) {}
+};
+#else
+#include "native/native_hal.h"
+#endif
@@ -1,16 +1,10 @@
 #pragma once
-#include "Arduino.h"
-
-//TODO:
-//- baudrate change
-//- stopping and starting reception
-
-//these two defines choose which serial port of the Due is used.
-//They need to match!
-#define LINSerial Serial1
-#define LIN_RX digitalPinToInterrupt(19)
+#include "LIN_hal.h"
+#include "ring_buffer.h"
+#include "timing.h"
 
 #define LIN_MEM_SIZE 64 //Defines the maximum number of unique frame indentifiers saved (only 64 possible)
+#define LIN_ID_BIT(id) (1ULL << (id)) //bit of a frame id in the 64-bit id sets
 
 //max frame time
 //According to: https://www.cs-group.de/wp-content/uploads/2016/11/LIN_Specification_Package_2.2A.pdf
@@ -23,94 +17,353 @@
 
 //the break field is at least the length of 11 bits
 #define LIN_MIN_BREAK_TIME 11000000UL / LIN_BAUD
+//half a bit, a start bit or a data bit low for less is a glitch
+#define LIN_HALF_BIT_TIME 500000UL / LIN_BAUD
+//the middle of the stop bit, measured from the start bit of the byte
+#define LIN_STOP_BIT_TIME 9500000UL / LIN_BAUD
+//a master has to send at least 13 bits, half a bit less is left for the edges
+#define LIN_NOMINAL_BREAK_TIME 12500000UL / LIN_BAUD
+
+//auto baud: the 0x55 sync field changes level every bit, its edges from the start bit to bit 7 span 8 bits.
+//Until the sync confirms it, anything as long as a break at the highest baudrate may be one
+#define LIN_AUTOBAUD_MIN 1000
+#define LIN_AUTOBAUD_MAX 20000
+#define LIN_AUTO_MIN_BREAK_TIME (11000000UL / LIN_AUTOBAUD_MAX)
+#define LIN_SYNC_EDGES 9
+#define LIN_RELOCK_PERCENT 5 //two syncs in a row this far off switch the baud, closer ones are averaged
+#define LIN_DRIFT_PERMILLE 5 //the averaged baud is applied between frames once it is this far off
+
+//a frame is complete when the bus is idle for LIN_IDLE_BITS after the last byte.
+//Time is measured from the last edge, which can be up to 10 bits before the end of the byte
+#define LIN_DEFAULT_IDLE_BITS 14
+#define LIN_IDLE_TIME ((10UL + LIN_IDLE_BITS) * 1000000UL / LIN_BAUD)
+
+//the USART sees the break field as a 0x00 byte (with a framing error), followed by the 0x55 sync byte
+#define LIN_BREAK_BYTE 0x00
+#define LIN_MAX_FRAME_BYTES 11  //sync + pid + 8 bytes + chk
+#define LIN_BREAK_BUFFER_SIZE 16 //number of detected breaks that can wait for the loop
+#define LIN_POLL_BYTES 16        //bytes taken from the USART per loop() call, so every bus gets its turn
+#define LIN_BYTE_STARTS 32       //start bits found by the interrupt, waiting for their bytes. Has to be a power of two
+#define LIN_FRAMING_ERRORS 8     //bytes with a low stop bit found by the interrupt, waiting for their frame. Has to be a power of two
+
+//diagnostic frames, they carry the messages of the transport layer (transport.h)
+#define LIN_MASTER_REQUEST 0x3C
+#define LIN_SLAVE_RESPONSE 0x3D
+
+//protected identifier of every frame id: the id with its parity bits P0 = ID0^ID1^ID2^ID4 (bit 6)
+//and P1 = !(ID1^ID3^ID4^ID5) (bit 7). A PID is valid if it is the entry of its own id
+const uint8_t PID_TABLE[LIN_MEM_SIZE] = {
+    0x80, 0xC1, 0x42, 0x03, 0xC4, 0x85, 0x06, 0x47, 0x08, 0x49, 0xCA, 0x8B, 0x4C, 0x0D, 0x8E, 0xCF,
+    0x50, 0x11, 0x92, 0xD3, 0x14, 0x55, 0xD6, 0x97, 0xD8, 0x99, 0x1A, 0x5B, 0x9C, 0xDD, 0x5E, 0x1F,
+    0x20, 0x61, 0xE2, 0xA3, 0x64, 0x25, 0xA6, 0xE7, 0xA8, 0xE9, 0x6A, 0x2B, 0xEC, 0xAD, 0x2E, 0x6F,
+    0xF0, 0xB1, 0x32, 0x73, 0xB4, 0xF5, 0x76, 0x37, 0x78, 0x39, 0xBA, 0xFB, 0x3C, 0x7D, 0xFE, 0xBF};
 
 //enum used to differenciate between states of LIN reception
 enum LIN_mode_t
 {
     waiting_for_break = 0, //waiting for break sign
     measuring_break,       //measuring the length of the break field
-    reading_bytes          //reading serial bytes
+    measuring_sync         //auto baud: timing the falling edges of the sync field
 };
 
 enum LIN_loop_state_t
 {
     initialize = 0,
-    wait_for_reading,
-    reading_delay,
+    wait_for_break,
+    reading_frame,
     stopped
 };
 
+//checksum models, also used as a bit set of the models a checksum matches
+enum checksum_model_t
+{
+    model_unknown = 0,
+    model_classic = 1, //data only (LIN 1.x and diagnostic frames)
+    model_enhanced = 2 //PID and data (LIN 2.x)
+};
+
+enum frame_status_t
+{
+    frame_valid = 0,
+    frame_parity_error,  //the parity bits of the PID are wrong, the id may be as well
+    frame_checksum_error //the checksum does not match the model of the id
+};
+
 //structure to conveniently store the frames
 struct data_frame
 {
+    uint8_t channel = 0;    //the LIN port the frame was received on
     uint8_t id = 0x00;      //the ID of the frame (don't mix up with PID)
     uint8_t data_count = 0; //number of bytes in the data section
     uint8_t data[8] = {0};  //data carried by the frame
     uint8_t chk = 0x00;     //checksum
+    unsigned long time = 0; //falling edge of the break, microseconds of hal::timestamp()
+    frame_status_t status = frame_valid;
 };
 
-namespace LIN_sniffer
+//what can be wrong with a frame besides its PID and checksum. Frames with no PID or too many bytes are
+//not reported as frames, the others are and get the remark
+enum malformed_t
 {
+    malformed_no_pid = 0,  //a break without sync and PID
+    malformed_header_only, //no slave responded
+    malformed_truncated,   //fewer bytes than the id had before and the checksum does not match
+    malformed_overlength,  //more bytes than a LIN frame can have
+    malformed_framing,     //a byte with a low stop bit
+    malformed_short_break, //a break shorter than the 13 bits a master has to send
+    MALFORMED_KINDS
+};
+
+//the raw bytes of a malformed frame
+struct malformed_frame
+{
+    uint8_t channel;
+    uint8_t kinds;      //bits of malformed_t
+    uint8_t byte_count; //bytes received after the break (up to 255), bytes holds the first LIN_MAX_FRAME_BYTES
+    uint8_t bytes[LIN_MAX_FRAME_BYTES];
+    unsigned long time;         //falling edge of the break
+    unsigned long break_length; //us
+};
+
+//a break field detected by the interrupt, passed on to the loop
+struct break_event
+{
+    unsigned long time;   //falling edge of the break
+    unsigned long length; //length of the break field
+    unsigned long sync;   //auto baud: 8 bit times measured on the sync field, 0 if not measured
+};
+
+//one LIN bus: break detection, frame assembly, validation and the frame store.
+//Nothing in here depends on the port, lin_sniffer<CHANNEL> (below) connects it to a UART and its RX pin
+class lin_bus
+{
+public:
+    explicit lin_bus(uint8_t _channel) : channel(_channel) { setBaud(LIN_BAUD); }
+
+    //the port specific part
+    virtual void init(void (*_MarkNewLoop)(uint8_t, uint8_t), void (*_MarkNewFrame)(data_frame &), void (*_MarkChangedFrame)(data_frame &, data_frame *), void (*_MarkUnchangedFrame)(data_frame &), void (*_MarkErrorFrame)(data_frame &), void (*_MarkDiagnosticFrame)(data_frame &), void (*_MarkMalformedFrame)(malformed_frame &)) = 0;
+    virtual void reset() = 0;
+    virtual void loop() = 0; //this function needs to be called in loop(), there can't be a long delay between calls!
+
+    //stopped, or between frames with no break on the way and nothing waiting for the loop - the loop can be away
+    //for a while then (the interrupt keeps the edges, the USART the bytes)
+    bool idle() { return LIN_state == stopped || (LIN_state == wait_for_break && LIN_mode == waiting_for_break && !zero_pending && break_events.empty()); }
+
+    const uint8_t channel; //number of the LIN port, every reported frame is tagged with it
     long LIN_BAUD = 19200;
+    long LIN_IDLE_BITS = LIN_DEFAULT_IDLE_BITS;
+    bool LIN_AUTOBAUD = false; //follow the baudrate measured on the sync fields, LIN_BAUD is the first guess
+    bool LIN_TRANSPORT = false; //diagnostic frames go to MarkDiagnosticFrame instead of being compared in FRAME_MEMORY
+    //times of LIN_BAUD and LIN_IDLE_BITS in us, worked out by setBaud() and setIdleBits() - the interrupt only compares
+    unsigned long half_bit_time;
+    unsigned long stop_bit_time;
+    unsigned long min_break_time;
+    unsigned long idle_time;
+    unsigned long max_frame_time;
     //volatile variables accessed from an interrupt
     volatile LIN_mode_t LIN_mode;
-    LIN_loop_state_t LIN_state;
+    LIN_loop_state_t LIN_state = initialize;
     volatile unsigned long break_time;
-    unsigned long reading_time;
+    volatile unsigned long last_edge_time; //time of the last edge on the bus, used to detect the end of a frame
+    ring_buffer<break_event, LIN_BREAK_BUFFER_SIZE> break_events; //breaks detected by the interrupt, waiting for the loop
+    break_event sync_break;                                       //auto baud: the break waiting for its sync field
+    unsigned long sync_edges[LIN_SYNC_EDGES];                     //auto baud: edges of the sync field
+    uint8_t sync_edge_count;
+    unsigned long sync_average; //auto baud: 8 bit times, averaged over the sync fields, 1/16 us
+    long relock_baud;           //auto baud: the last sync far off the baudrate, switched to if the next one agrees
+    long pending_baud;          //auto baud: drift correction waiting for the bus to be between frames, 0 - none
+    //frame assembly
+    uint8_t frame_bytes[LIN_MAX_FRAME_BYTES]; //sync + pid + data + chk of the frame being received
+    uint8_t frame_byte_count;
+    bool frame_overflow;       //more bytes were received than a LIN frame can have
+    bool frame_discarded;      //the baud was switched while receiving the frame
+    uint8_t frame_extra_bytes; //received after the frame was full, up to 255
+    bool zero_pending;         //a 0x00 byte was received - it is either the break or data, the next byte tells
+    unsigned long frame_start; //end of the break of the frame being received
+    unsigned long frame_time;  //falling edge of the break of the frame being received
+    unsigned long frame_break; //length of the break of the frame being received
     //global variables
-    data_frame FRAME_MEMORY[LIN_MEM_SIZE]; //stores the last received instance of each frame id
-    uint8_t frame_loop[LIN_MEM_SIZE];      //stores which frame ids have been received in this schedule loop. Duplicate id - new loop
+    data_frame FRAME_MEMORY[LIN_MEM_SIZE]; //stores the last received instance of each frame id, indexed by the id
+    uint64_t saved_frames;                 //ids stored in FRAME_MEMORY, one bit per id
+    uint64_t loop_frames;                  //ids received in this schedule loop, one bit per id. Duplicate id - new loop
     uint8_t frame_loop_count;              //stores how many different ids were received in this loop
-    uint8_t saved_frames_count;            //stores how many different ids are stored in FRAME_MEMORY
+    uint8_t response_length[LIN_MEM_SIZE]; //number of data bytes last seen with a valid checksum for each id (0 - unknown)
+    checksum_model_t checksum_model[LIN_MEM_SIZE]; //learned from the first frame of each id with a valid checksum
+    uint32_t parity_errors[LIN_MEM_SIZE];          //frames with a wrong PID parity, counted for the id in the PID
+    uint32_t checksum_errors[LIN_MEM_SIZE];        //frames with a checksum that does not match the model of the id
+    //statistics - only counted here, the windows and rates are worked out in statistics.h
+    uint32_t frame_count[LIN_MEM_SIZE] = {}; //frames received with each id, counted for the id in the PID
+    uint32_t frames = 0;                     //all frames with a PID
+    volatile uint32_t glitches = 0;          //low pulses shorter than half a bit, rejected by the interrupt
+    uint32_t dropped_frames = 0;             //frames not reported: more bytes than a LIN frame, a baud switch or no PID
+    uint64_t busy_time = 0;                  //us the bus carried frames (break + 10 bits per byte)
+    uint64_t callback_cycles = 0;            //spent in the Mark* callbacks
+    uint32_t max_callback_cycles = 0;        //the longest callback since the statistics last took this
+    //timing: the interrupt finds the start bit of every byte, the loop pairs them with the bytes of the USART
+    unsigned long byte_start_time;                           //interrupt: start bit of the last byte
+    unsigned long start_candidate;                           //interrupt: a falling edge that may be a start bit, confirmed by the next edge
+    bool start_pending = false;
+    ring_buffer<unsigned long, LIN_BYTE_STARTS> byte_starts; //start bits waiting for their bytes
+    unsigned long byte_times[LIN_MAX_FRAME_BYTES];           //start bit of every byte of the frame being received
+    bool timing_valid;                                       //every byte of the frame got its start bit
+    id_timing timing[LIN_MEM_SIZE] = {};
+    //malformed frames: the interrupt finds the bytes with a low stop bit, the loop classifies the frames
+    unsigned long fall_time;                                     //interrupt: the last falling edge
+    ring_buffer<unsigned long, LIN_FRAMING_ERRORS> framing_errors; //start bits of the bytes with a low stop bit
+    uint32_t malformed[MALFORMED_KINDS] = {};                    //frames of every kind, a frame can be of several
+    uint32_t stray_bytes = 0;                                    //bytes received outside of any frame
 
     //function pointers to be defined by the user!
-    void (*MarkNewLoop)(uint8_t);
+    void (*MarkNewLoop)(uint8_t channel, uint8_t frames);
     void (*MarkNewFrame)(data_frame &frame);
     void (*MarkChangedFrame)(data_frame &frame, data_frame *old_frame);
     void (*MarkUnchangedFrame)(data_frame &frame);
+    void (*MarkErrorFrame)(data_frame &frame);
+    void (*MarkDiagnosticFrame)(data_frame &frame);
+    void (*MarkMalformedFrame)(malformed_frame &frame);
 
     //functions
-    void LIN_RX_interrupt()
+    //the port is not touched, see setPortBaud()
+    void setBaud(long baud)
     {
+        LIN_BAUD = baud;
+        half_bit_time = LIN_HALF_BIT_TIME;
+        stop_bit_time = LIN_STOP_BIT_TIME;
+        min_break_time = LIN_MIN_BREAK_TIME;
+        max_frame_time = LIN_MAX_FRAME_TIME;
+        idle_time = LIN_IDLE_TIME;
+    }
+    void setIdleBits(long bits)
+    {
+        LIN_IDLE_BITS = bits;
+        idle_time = LIN_IDLE_TIME;
+    }
+    //auto baud: the edges of a sync field are one bit apart (within 1/4 bit) and the break is at least 11 of its bits long.
+    //Only then the break is passed on, together with the measured bit time
+    void checkSync()
+    {
+        unsigned long sync = sync_edges[LIN_SYNC_EDGES - 1] - sync_edges[0];
+        for (uint8_t i = 1; i < LIN_SYNC_EDGES; ++i)
+        {
+            unsigned long spacing = (sync_edges[i] - sync_edges[i - 1]) * 8;
+            if (spacing > sync + sync / 4 || spacing + sync / 4 < sync)
+                return;
+        }
+        if (sync_break.length * 8 < sync * 11)
+            return;
+        sync_break.sync = sync;
+        break_events.push(sync_break);
+    }
+    //called from the RX edge interrupt with the time of the edge and the new level of the line
+    void edge(unsigned long now, bool level)
+    {
+        //the interrupt stays attached all the time, the USART reads the bytes in parallel
         //depending on the actual LIN state and pin state, proceed to different state
+        last_edge_time = now;
+        //a falling edge 9.5 bits after the last start bit starts the next byte (or a break). It is taken once
+        //the line stayed low for half a bit, glitches are not
+        if (start_pending && level)
+        {
+            start_pending = false;
+            if (now - start_candidate >= half_bit_time)
+            {
+                byte_start_time = start_candidate;
+                byte_starts.push(start_candidate);
+            }
+        }
+        else if (!level && now - byte_start_time >= stop_bit_time)
+        {
+            start_candidate = now;
+            start_pending = true;
+        }
+        //the line went low before the middle of the stop bit and stayed low past it. Low for as long as a break, it is one
+        if (level)
+        {
+            unsigned long stop = byte_start_time + stop_bit_time;
+            if ((long)(fall_time - stop) <= 0 && (long)(now - stop) > 0 && now - byte_start_time < min_break_time)
+                framing_errors.push(byte_start_time);
+        }
+        else
+            fall_time = now;
         switch (LIN_mode)
         {
         case waiting_for_break:
-            //if a falling edge is detected, start measuring how long the break field is
-            if (!digitalRead(LIN_RX))
+            //if a falling edge is detected, start measuring how long the low level is
+            if (!level)
             {
-                break_time = micros();
+                break_time = now;
                 LIN_mode = measuring_break;
             }
             return;
 
         case measuring_break:
-            if (digitalRead(LIN_RX))
+            if (level)
+            {
+                //the break field is at least the length of 11 bits, any data bit pattern is shorter
+                if (now - break_time >= (LIN_AUTOBAUD ? LIN_AUTO_MIN_BREAK_TIME : min_break_time))
+                {
+                    break_event event = {break_time, now - break_time, 0};
+                    if (LIN_AUTOBAUD)
+                    {
+                        //the bit time is not known yet, the sync field tells whether this was a break
+                        sync_break = event;
+                        sync_edge_count = 0;
+                        LIN_mode = measuring_sync;
+                        return;
+                    }
+                    break_events.push(event);
+                }
+                //if the length is too short - it was a data byte or a glitch. Keep waiting.
+                //Data bits are at least one bit long, anything below half a bit is noise (the USART ignores it as well)
+                else if (now - break_time < half_bit_time)
+                    ++glitches;
+                LIN_mode = waiting_for_break;
+            }
+            return;
+
+        case measuring_sync:
+            if (level)
             {
-                //the break field is at least the length of 11 bits
-                if (micros() - break_time >= LIN_MIN_BREAK_TIME)
+                if (sync_edge_count == 0)
+                    return; //the sync field starts with the falling edge of its start bit
+                //a sync bit is at most 1/11 of the break. Low for half as long - that one may be the break
+                //the sync field has to follow (the one before was a long run of data bits)
+                unsigned long low = now - sync_edges[sync_edge_count - 1];
+                if (low >= LIN_AUTO_MIN_BREAK_TIME && low * 2 >= sync_break.length)
                 {
-                    //for reading the bytes, the interrupt is not needed
-                    LIN_mode = reading_bytes;
-                    detachInterrupt(digitalPinToInterrupt(LIN_RX));
+                    sync_break.time = sync_edges[sync_edge_count - 1];
+                    sync_break.length = low;
+                    sync_edge_count = 0;
+                    return;
                 }
-                else //if the length is too short - it could be a glitch or something went wrong. Try again until a correct break is received
-                    LIN_mode = waiting_for_break;
+            }
+            sync_edges[sync_edge_count++] = now;
+            if (sync_edge_count == LIN_SYNC_EDGES)
+            {
+                checkSync();
+                //like any falling edge, this one may start the next break
+                break_time = now;
+                LIN_mode = measuring_break;
             }
             return;
-        default:
-            return; //this should not be reached.
-                    //the interrupt is turned off when reading bytes!
         }
     };
-    void reset()
+    //forgets everything learned about the bus
+    void clear()
     {
+        loop_frames = 0;
         frame_loop_count = 0;
-        saved_frames_count = 0;
-        if(LIN_state == reading_delay){
-            LINSerial.end();
-        }
-        LIN_state = stopped;
+        saved_frames = 0;
+        memset(response_length, 0, sizeof(response_length));
+        memset(checksum_model, 0, sizeof(checksum_model));
+        //diagnostic frames always use the classic checksum
+        checksum_model[0x3C] = model_classic;
+        checksum_model[0x3D] = model_classic;
+        memset(parity_errors, 0, sizeof(parity_errors));
+        memset(checksum_errors, 0, sizeof(checksum_errors));
+        sync_average = 0;
+        pending_baud = 0;
+        relock_baud = 0;
     }
     void dataToFrame(data_frame &frame, uint8_t *data, uint8_t data_count)
     {
@@ -123,111 +376,532 @@ namespace LIN_sniffer
             memcpy(frame.data, data + 2, frame.data_count);
         }
     }
-    void init(void (*_MarkNewLoop)(uint8_t) = nullptr, void (*_MarkNewFrame)(data_frame &) = nullptr, void (*_MarkChangedFrame)(data_frame &, data_frame *) = nullptr, void (*_MarkUnchangedFrame)(data_frame &) = nullptr)
+    //LIN checksum: 8-bit sum with carry, inverted. The enhanced model includes the PID
+    uint8_t checksum(uint8_t *data, uint8_t data_count, uint8_t pid)
+    {
+        uint16_t sum = pid;
+        for (uint8_t i = 0; i < data_count; ++i)
+        {
+            sum += data[i];
+            if (sum > 0xFF)
+                sum -= 0xFF;
+        }
+        return ~sum;
+    }
+    //bytes are sync + pid + data + chk, returns the set of models the checksum matches.
+    //The data is summed once, the enhanced model only adds the PID to it
+    uint8_t checksumModels(uint8_t *bytes, uint8_t byte_count)
+    {
+        if (byte_count < 4)
+            return model_unknown;
+        uint8_t chk = bytes[byte_count - 1];
+        uint16_t sum = 0;
+        for (uint8_t i = 2; i < byte_count - 1; ++i)
+        {
+            sum += bytes[i];
+            if (sum > 0xFF)
+                sum -= 0xFF;
+        }
+        uint8_t models = (uint8_t)~sum == chk ? model_classic : model_unknown;
+        sum += bytes[1];
+        if (sum > 0xFF)
+            sum -= 0xFF;
+        if ((uint8_t)~sum == chk)
+            models |= model_enhanced;
+        return models;
+    }
+    //checks the model learned for the id, or both while it is unknown
+    bool checksumValid(uint8_t *bytes, uint8_t byte_count)
+    {
+        uint8_t models = checksumModels(bytes, byte_count);
+        checksum_model_t model = checksum_model[bytes[1] & 0x3F];
+        return model == model_unknown ? models != model_unknown : (models & model) != 0;
+    }
+    //checks the PID parity and the checksum, learns the checksum model of the id from its first valid frame
+    frame_status_t frameStatus(uint8_t *bytes, uint8_t byte_count)
+    {
+        uint8_t id = bytes[1] & 0x3F;
+        if (PID_TABLE[id] != bytes[1])
+        {
+            ++parity_errors[id];
+            return frame_parity_error;
+        }
+        if (byte_count < 4)
+            return frame_valid; //header only, there is no checksum to check
+        uint8_t models = checksumModels(bytes, byte_count);
+        if (checksum_model[id] == model_unknown && models != model_unknown)
+            checksum_model[id] = (models & model_enhanced) ? model_enhanced : model_classic;
+        if ((models & checksum_model[id]) == 0)
+        {
+            ++checksum_errors[id];
+            return frame_checksum_error;
+        }
+        return frame_valid;
+    }
+    //compares everything but the time of the frames.
+    //Unused data bytes are always zero, so the whole payload is compared at once
+    bool sameContents(const data_frame &a, const data_frame &b)
+    {
+        return a.data_count == b.data_count && a.chk == b.chk && memcmp(a.data, b.data, sizeof(a.data)) == 0;
+    }
+    //sets the counters of the statistics to zero
+    void clearStats()
+    {
+        memset(frame_count, 0, sizeof(frame_count));
+        frames = 0;
+        glitches = 0;
+        dropped_frames = 0;
+        busy_time = 0;
+        callback_cycles = 0;
+        max_callback_cycles = 0;
+    }
+    void clearTiming()
+    {
+        memset(timing, 0, sizeof(timing));
+    }
+    void clearMalformed()
+    {
+        memset(malformed, 0, sizeof(malformed));
+        stray_bytes = 0;
+    }
+    //whether a byte of the frame being closed had a low stop bit. Earlier ones were outside of any frame
+    bool framingError()
+    {
+        unsigned long last = frame_start;
+        if (timing_valid && frame_byte_count && !frame_overflow)
+            last = byte_times[frame_byte_count - 1];
+        else if (frame_byte_count)
+            last = frame_start + (frame_byte_count + frame_extra_bytes) * 14000000UL / LIN_BAUD; //1.4 times the nominal byte time
+        bool found = false;
+        unsigned long start;
+        while (framing_errors.peek(start) && (long)(start - last) <= 0)
+        {
+            framing_errors.pop(start);
+            found |= (long)(start - frame_time) >= 0;
+        }
+        //a frame complete with its checksum is closed before the low stop bit of the checksum is over
+        unsigned long last_edge = last_edge_time;
+        unsigned long fall = fall_time;
+        if (fall == last_edge && timing_valid && frame_byte_count && !frame_overflow &&
+            (long)(fall - last) >= 0 && fall - last <= stop_bit_time)
+            found = true;
+        return found;
+    }
+    //what is wrong with the frame being closed (bits of malformed_t)
+    uint8_t malformedKinds()
+    {
+        uint8_t kinds = 0;
+        if (frame_break < LIN_NOMINAL_BREAK_TIME)
+            kinds |= 1 << malformed_short_break;
+        if (framingError())
+            kinds |= 1 << malformed_framing;
+        if (frame_overflow)
+            kinds |= 1 << malformed_overlength;
+        if (frame_byte_count <= 1)
+            kinds |= 1 << malformed_no_pid;
+        else if (frame_byte_count == 2)
+            kinds |= 1 << malformed_header_only;
+        else if (PID_TABLE[frame_bytes[1] & 0x3F] == frame_bytes[1])
+        {
+            uint8_t length = response_length[frame_bytes[1] & 0x3F];
+            if (length && frame_byte_count < length + 3 && !checksumValid(frame_bytes, frame_byte_count))
+                kinds |= 1 << malformed_truncated;
+        }
+        return kinds;
+    }
+    //counts the frame for every kind it is of and passes the raw bytes on
+    void reportMalformed(uint8_t kinds)
+    {
+        malformed_frame frame;
+        frame.channel = channel;
+        frame.kinds = kinds;
+        frame.byte_count = frame_byte_count + frame_extra_bytes < 255 ? frame_byte_count + frame_extra_bytes : 255;
+        memcpy(frame.bytes, frame_bytes, frame_byte_count);
+        frame.time = frame_time;
+        frame.break_length = frame_break;
+        for (uint8_t kind = 0; kind < MALFORMED_KINDS; ++kind)
+            if (kinds & (1 << kind))
+                ++malformed[kind];
+        uint32_t start = hal::cycles();
+        MarkMalformedFrame(frame);
+        countCallback(start);
+    }
+    //cycles spent since start in the callbacks
+    void countCallback(uint32_t start)
+    {
+        uint32_t cycles = hal::cycles() - start;
+        callback_cycles += cycles;
+        if (cycles > max_callback_cycles)
+            max_callback_cycles = cycles;
+    }
+    //the timing of a frame with a valid PID, from the start bits of its bytes
+    void measureTiming(uint8_t id, uint8_t byte_count)
+    {
+        if (!timing_valid)
+            return;
+        id_timing &t = timing[id];
+        uint32_t bit = 100000000UL / LIN_BAUD; //us * 100
+        unsigned long byte_time = 10000000UL / LIN_BAUD;
+        unsigned long header_end = byte_times[1] + byte_time;
+        uint32_t header = header_end - frame_time;
+        t.metrics[timing_break].add(timing_break, frame_break, bit * TIMING_BREAK_BITS);
+        t.metrics[timing_header].add(timing_header, header, bit * TIMING_HEADER_BITS);
+        if ((uint64_t)header * 100 > (uint64_t)bit * TIMING_HEADER_BITS * TIMING_TOLERANCE_PERCENT / 100)
+            ++t.late_headers;
+        if (byte_count == 2)
+        {
+            ++t.no_response;
+            return;
+        }
+        //bytes overlapping the one before (a baud a little off) have no space
+        long delay = byte_times[2] - header_end;
+        t.metrics[timing_delay].add(timing_delay, delay > 0 ? delay : 0, bit);
+        long gap = 0;
+        for (uint8_t i = 3; i < byte_count; ++i)
+        {
+            long space = byte_times[i] - (byte_times[i - 1] + byte_time);
+            if (space > gap)
+                gap = space;
+        }
+        if (byte_count > 3)
+            t.metrics[timing_gap].add(timing_gap, gap, bit);
+        uint32_t response = byte_times[byte_count - 1] + byte_time - header_end;
+        uint32_t nominal = bit * 10 * (byte_count - 2);
+        t.metrics[timing_response].add(timing_response, response, nominal);
+        if ((uint64_t)response * 100 > (uint64_t)nominal * TIMING_TOLERANCE_PERCENT / 100)
+            ++t.late_responses;
+    }
+    void processFrame(uint8_t *data, uint8_t data_count)
+    {
+        if (data_count <= 1) //we need at least sync + pid!
+        {
+            ++dropped_frames;
+            return;
+        }
+
+        hal::frameReceived(channel, data, data_count);
+        //we have at least pid, save this frame
+        data_frame newframe;
+        newframe.channel = channel;
+        dataToFrame(newframe, data, data_count);
+        newframe.time = frame_time;
+        newframe.status = frameStatus(data, data_count);
+        ++frame_count[newframe.id];
+        if (newframe.status != frame_parity_error)
+            measureTiming(newframe.id, data_count);
+        ++frames;
+        uint32_t start = hal::cycles();
+        //a damaged frame says nothing about the schedule or the contents of its id
+        if (newframe.status != frame_valid)
+        {
+            MarkErrorFrame(newframe);
+            countCallback(start);
+            return;
+        }
+        uint64_t id_bit = LIN_ID_BIT(newframe.id);
+        //if this id was already received in this loop - start the loop over again
+        if (loop_frames & id_bit)
+        {
+            MarkNewLoop(channel, frame_loop_count);
+            loop_frames = 0;
+            frame_loop_count = 0;
+        }
+        loop_frames |= id_bit;
+        ++frame_loop_count;
+        //the contents of diagnostic frames are parts of messages, comparing them to the last frame says nothing
+        if (LIN_TRANSPORT && (newframe.id == LIN_MASTER_REQUEST || newframe.id == LIN_SLAVE_RESPONSE))
+        {
+            MarkDiagnosticFrame(newframe);
+            countCallback(start);
+            return;
+        }
+
+        //Have the exact frame be already received, or one with same pid?
+        data_frame &saved = FRAME_MEMORY[newframe.id];
+        if (saved_frames & id_bit)
+        {
+            //if id is the same, what about the contents? - act accordingly
+            if (sameContents(newframe, saved))
+                MarkUnchangedFrame(newframe);
+            else
+            {
+                //we need to save the new values!
+                MarkChangedFrame(newframe, &saved);
+                saved = newframe;
+            }
+        }
+        else
+        {
+            //if the frame was not received before - save it
+            MarkNewFrame(newframe);
+            saved = newframe;
+            saved_frames |= id_bit;
+        }
+        countCallback(start);
+    }
+    void closeFrame()
+    {
+        if (LIN_state == reading_frame)
+        {
+            busy_time += frame_break + (frame_byte_count + frame_extra_bytes) * 10000000UL / LIN_BAUD;
+            //a frame received with the wrong baud says nothing about the bus
+            uint8_t kinds = frame_discarded ? 0 : malformedKinds();
+            if (kinds)
+                reportMalformed(kinds);
+            //frames with extra bytes are not reported
+            if (frame_overflow || frame_discarded)
+                ++dropped_frames;
+            else
+            {
+                processFrame(frame_bytes, frame_byte_count);
+                //remember the length, so the next frames of this id can be closed as soon as they are complete
+                if (frame_byte_count >= 4 && PID_TABLE[frame_bytes[1] & 0x3F] == frame_bytes[1] && checksumValid(frame_bytes, frame_byte_count))
+                    response_length[frame_bytes[1] & 0x3F] = frame_byte_count - 3;
+            }
+        }
+        frame_byte_count = 0;
+        frame_overflow = false;
+        frame_discarded = false;
+        frame_extra_bytes = 0;
+        LIN_state = wait_for_break;
+    }
+    //the start bit of the byte at index of the frame
+    void takeByteStart(uint8_t index)
+    {
+        unsigned long start;
+        if (byte_starts.pop(start))
+            byte_times[index] = start;
+        else
+            timing_valid = false;
+    }
+    void appendByte(uint8_t byte)
+    {
+        //bytes without a preceding break are not part of a frame we can decode
+        if (LIN_state != reading_frame)
+        {
+            ++stray_bytes;
+            return;
+        }
+        if (frame_byte_count < LIN_MAX_FRAME_BYTES)
+        {
+            takeByteStart(frame_byte_count);
+            frame_bytes[frame_byte_count++] = byte;
+        }
+        else
+        {
+            frame_overflow = true;
+            if (frame_extra_bytes < 255)
+                ++frame_extra_bytes;
+        }
+    }
+    //true if the frame has the length learned for its id and the checksum lines up
+    bool responseComplete()
+    {
+        if (frame_byte_count < 4)
+            return false;
+        uint8_t length = response_length[frame_bytes[1] & 0x3F];
+        return length != 0 && frame_byte_count == length + 3 && checksumValid(frame_bytes, frame_byte_count);
+    }
+    //auto baud: follows the bit time measured on a sync field
+    void followSync(unsigned long sync)
+    {
+        long baud = 8000000L / sync;
+        if (baud < LIN_AUTOBAUD_MIN || baud > LIN_AUTOBAUD_MAX)
+            return;
+        //far off (e.g. the first frames) - switch right away once a second sync agrees,
+        //this frame was received with the wrong baud
+        if (labs(baud - LIN_BAUD) * 100 > LIN_BAUD * LIN_RELOCK_PERCENT)
+        {
+            bool agrees = labs(baud - relock_baud) * 100 <= baud * LIN_RELOCK_PERCENT;
+            relock_baud = baud;
+            if (!agrees)
+                return;
+            setBaud(baud);
+            setPortBaud(baud);
+            sync_average = sync * 16;
+            pending_baud = 0;
+            frame_discarded = true;
+            return;
+        }
+        relock_baud = 0;
+        //drift - averaged over 8 sync fields
+        if (sync_average == 0)
+            sync_average = sync * 16;
+        sync_average += sync * 2 - sync_average / 8;
+        baud = 8000000L * 16 / sync_average;
+        pending_baud = labs(baud - LIN_BAUD) * 1000 > LIN_BAUD * LIN_DRIFT_PERMILLE ? baud : 0;
+    }
+    //the interrupt confirmed the break - the previous frame is complete
+    void startFrame(const break_event &event)
+    {
+        closeFrame();
+        frame_start = event.time + event.length;
+        frame_time = event.time;
+        frame_break = event.length;
+        LIN_state = reading_frame;
+        //start bits up to the break are of bytes that belong to no frame, and the break itself
+        unsigned long start;
+        while (byte_starts.peek(start) && (long)(start - event.time) <= 0)
+            byte_starts.pop(start);
+        timing_valid = true;
+        if (event.sync)
+            followSync(event.sync);
+    }
+    //decides whether the pending 0x00 byte was a break field (true) or data (false)
+    bool resolveZero()
+    {
+        zero_pending = false;
+        break_event event;
+        if (!break_events.pop(event))
+        {
+            appendByte(LIN_BREAK_BYTE);
+            return false;
+        }
+        startFrame(event);
+        return true;
+    }
+    void receiveByte(uint8_t byte)
+    {
+        if (byte == LIN_BREAK_BYTE)
+        {
+            //two zeros in a row: the first one can only be data, the break is followed by 0x55
+            if (zero_pending)
+            {
+                zero_pending = false;
+                appendByte(LIN_BREAK_BYTE);
+            }
+            else if (LIN_state == reading_frame && frame_byte_count < LIN_MAX_FRAME_BYTES)
+            {
+                //a zero that completes a known response is its checksum, not the next break
+                frame_bytes[frame_byte_count++] = byte;
+                if (responseComplete())
+                {
+                    takeByteStart(frame_byte_count - 1);
+                    closeFrame();
+                    return;
+                }
+                --frame_byte_count;
+            }
+            zero_pending = true;
+            return;
+        }
+        if (zero_pending)
+            resolveZero();
+        appendByte(byte);
+        if (frame_byte_count == LIN_MAX_FRAME_BYTES || responseComplete())
+            closeFrame(); //nothing more can belong to this frame
+    }
+
+protected:
+    //changes the baudrate of the running USART
+    virtual void setPortBaud(long baud) = 0;
+};
+
+//a LIN bus on one of the ports of hal::lin_port (UART and RX pin)
+template <uint8_t CHANNEL>
+class lin_sniffer : public lin_bus
+{
+public:
+    lin_sniffer() : lin_bus(CHANNEL) {}
+
+    void init(void (*_MarkNewLoop)(uint8_t, uint8_t), void (*_MarkNewFrame)(data_frame &), void (*_MarkChangedFrame)(data_frame &, data_frame *), void (*_MarkUnchangedFrame)(data_frame &), void (*_MarkErrorFrame)(data_frame &), void (*_MarkDiagnosticFrame)(data_frame &), void (*_MarkMalformedFrame)(malformed_frame &))
     {
         MarkNewLoop = _MarkNewLoop;
         MarkNewFrame = _MarkNewFrame;
         MarkChangedFrame = _MarkChangedFrame;
         MarkUnchangedFrame = _MarkUnchangedFrame;
-        pinMode(LIN_RX, INPUT_PULLUP);
+        MarkErrorFrame = _MarkErrorFrame;
+        MarkDiagnosticFrame = _MarkDiagnosticFrame;
+        MarkMalformedFrame = _MarkMalformedFrame;
+        instance = this;
+        hal::rxInit<CHANNEL>();
         reset();
     }
-    void loop() //this function needs to be called in loop(), there can't be a long delay between calls!
+    void reset()
+    {
+        clear();
+        if (LIN_state != stopped && LIN_state != initialize)
+        {
+            hal::detachRxEdge<CHANNEL>();
+            hal::linEnd<CHANNEL>();
+        }
+        LIN_state = stopped;
+    }
+    void loop()
     {
         switch (LIN_state)
         {
-        case wait_for_reading:
+        case initialize:
         {
-            if (LIN_mode != reading_bytes)
-                break; //the interrupt handles receiving of the break signal
-
-            //after the break signal is received, quickly turn on serial communication
-            LINSerial.begin(LIN_BAUD, SERIAL_8N1);
-            LINSerial.setTimeout(0);
-            reading_time = micros();
-            LIN_state = reading_delay;
-            //no break needed
+            //the serial port and the interrupt stay on for the whole reception
+            break_events.clear();
+            byte_starts.clear();
+            framing_errors.clear();
+            start_pending = false;
+            frame_byte_count = 0;
+            frame_overflow = false;
+            frame_discarded = false;
+            frame_extra_bytes = 0;
+            zero_pending = false;
+            LIN_mode = waiting_for_break;
+            hal::linBegin<CHANNEL>(LIN_BAUD);
+            hal::attachRxEdge<CHANNEL>(LIN_RX_interrupt);
+            LIN_state = wait_for_break;
+            break;
         }
-        case reading_delay:
+        case wait_for_break:
+        case reading_frame:
         {
-            //wait a calculated number of time
-            if (micros() - reading_time <= LIN_MAX_FRAME_TIME)
+            break_event queued, event;
+            bool was_queued = break_events.peek(queued);
+
+            //the USART interrupt buffers the bytes, take what arrived - at most LIN_POLL_BYTES, the other buses are next
+            uint8_t budget = LIN_POLL_BYTES;
+            while (budget && hal::linAvailable<CHANNEL>())
+            {
+                receiveByte(hal::linRead<CHANNEL>());
+                --budget;
+            }
+            //everything below needs all bytes received so far, otherwise it is done on the next call
+            if (hal::linAvailable<CHANNEL>())
                 break;
 
-            //check how many bytes have been received
-            uint8_t data_count = LINSerial.available();
-            uint8_t data_count_read;
-            uint8_t data[11] = {0}; //eleven bytes is maximum (sync + pid + 8 bytes + chk)
+            //the zero of a break is received before the break is over. If the break was queued before reading
+            //and still no zero came with it, the zero was lost (e.g. merged with a glitch) - start the frame anyway
+            if (was_queued && !zero_pending && break_events.peek(event) && event.time == queued.time)
+            {
+                break_events.pop(event);
+                startFrame(event);
+            }
 
-            data_count_read = LINSerial.readBytes(data, min(11, data_count));
-            //the serial communication can be stopped
-            LINSerial.end();
+            //nothing comes after the zero and the break was confirmed - a header without sync
+            if (zero_pending && !break_events.empty())
+                resolveZero();
 
-            //analyse the received data
-            if (data_count_read == data_count && data_count > 1) //we need at least sync + pid!
+            if (LIN_state == reading_frame)
             {
-                //we have at least pid, save this frame
-                data_frame newframe;
-                dataToFrame(newframe, data, data_count);
-                //was this id of frame received in this loop?
-                bool is_new = true;
-                for (int i = 0; i < frame_loop_count; ++i)
+                unsigned long last_edge = last_edge_time; //read before the timestamp, the interrupt can't make it newer than now
+                unsigned long now = hal::timestamp();
+                //after the header the slave may take its time to respond, only the whole frame time limits it.
+                //Once the response started, the bus going idle (high) ends the frame
+                bool idle = frame_byte_count > 2 && LIN_mode != measuring_break && now - last_edge > idle_time;
+                //no frame can be longer than this - stop waiting for the rest of it
+                if (idle || now - frame_start > max_frame_time)
                 {
-                    //if this id was already received in this loop - start the loop over again
-                    if (frame_loop[i] == newframe.id)
-                    {
-                        MarkNewLoop(frame_loop_count);
-                        frame_loop[0] = newframe.id;
-                        frame_loop_count = 1;
-                        is_new = false;
-                        break;
-                    }
-                }
-                //if the frame was not received in this loop - store it
-                if (is_new)
-                {
-                    frame_loop[frame_loop_count] = newframe.id;
-                    ++frame_loop_count;
-                }
-
-                //Have the exact frame be already received, or one with same pid?
-                is_new = true;
-                for (int i = 0; i < saved_frames_count; ++i)
-                {
-                    //look for frame with the same id
-                    if (newframe.id == FRAME_MEMORY[i].id)
-                    {
-                        is_new = false;
-                        //if id is the same, what about the contents? - act accordingly
-                        if (memcmp(&newframe, FRAME_MEMORY + i, sizeof(data_frame)) == 0)
-                            MarkUnchangedFrame(newframe);
-                        else
-                        {
-                            //we need to save the new values!
-                            MarkChangedFrame(newframe, FRAME_MEMORY + i);
-                            memcpy(FRAME_MEMORY + i, &newframe, sizeof(data_frame));
-                        }
-                        break;
-                    }
+                    //a pending zero is data now, unless the next break has just been confirmed
+                    bool next_frame = zero_pending && resolveZero();
+                    if (!next_frame)
+                        closeFrame();
                 }
+            }
 
-                //if the frame was not received before - save it
-                if (is_new)
-                {
-                    MarkNewFrame(newframe);
-                    //add frame to the list
-                    memcpy(FRAME_MEMORY + saved_frames_count, &newframe, sizeof(data_frame));
-                    ++saved_frames_count;
-                }
+            //auto baud: drift is corrected between frames, while no byte is on its way
+            if (pending_baud && LIN_state == wait_for_break && LIN_mode == waiting_for_break && !zero_pending && break_events.empty())
+            {
+                setBaud(pending_baud);
+                setPortBaud(pending_baud);
+                pending_baud = 0;
             }
-            //no need for break or changing the state - just initialize again
-        }
-        case initialize:
-        {
-            //first: activer the interrupt
-            LIN_mode = waiting_for_break;
-            attachInterrupt(LIN_RX, LIN_RX_interrupt, CHANGE);
-            LIN_state = wait_for_reading;
             break;
         }
         case stopped:
@@ -237,4 +911,14 @@ namespace LIN_sniffer
         }
         }
     }
-};
\ No newline at end of file
+
+protected:
+    void setPortBaud(long baud) { hal::linSetBaud<CHANNEL>(baud); }
+
+private:
+    static lin_sniffer *instance; //there is one sniffer per port, the interrupt handler finds it here
+    static void LIN_RX_interrupt() { instance->edge(hal::timestamp(), hal::rxLevel<CHANNEL>()); }
+};
+
+template <uint8_t CHANNEL>
+lin_sniffer<CHANNEL> *lin_sniffer<CHANNEL>::instance = nullptr;
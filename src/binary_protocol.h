@@ -0,0 +1,191 @@
+#pragma once
+//binary output protocol, shared by the sniffer and the host decoder (tools/)
+//Every record is COBS encoded and ends with a 0x00 delimiter, so a receiver can always find the start of the next one.
+//Text (command replies) is kept apart from records by a delimiter after it.
+//
+//record layout (little endian):
+//  0     record type
+//  1..   type specific fields (see below)
+//  last  CRC-8 (polynomial 0x07) of all bytes before it
+//
+//record_frame:    type, flags, channel, id, data count, time (4 bytes, us), data (data count bytes), chk
+//record_new_loop: type, channel, number of frames in the finished loop, time (4 bytes, us)
+//record_drops:    type, reports dropped (4 bytes), frames coalesced (4 bytes) since the last record_drops
+//record_stats:    type, period (4 bytes, ms), longest loop() (4 bytes, ns), time in the callbacks (2 bytes, permille),
+//                 longest callback (4 bytes, ns), output queue high water (2 bytes)
+//record_bus_stats: type, channel, frames (4 bytes), bus load (2 bytes, permille), glitches (4 bytes),
+//                 dropped frames (4 bytes) - in the period of the record_stats in front of it
+//record_trigger:  type, event (1 - fired, the dumped frames follow, 2 - end of the dump), trigger number,
+//                 channel (0 - any), time (4 bytes, us), frames lost from the dump (2 bytes, end only)
+//record_signals:  type, channel, id, time (4 bytes, us), number of signals, then for every signal that changed:
+//                 its number in the signal list, physical value (4 bytes, IEEE 754 float)
+//record_schedule: type, event, channel, table, slot, id, count, time (4 bytes, us),
+//                 measured and expected time (4 bytes each, us)
+//record_diagnostic: type, status, channel, id (0x3C request, 0x3D response), NAD, length (2 bytes, announced),
+//                 received (2 bytes), time (4 bytes, us), duration (4 bytes, us), time after the request (4 bytes, us,
+//                 responses, 0 - none), data count, data (the first data count bytes of the message)
+//record_malformed: type, channel, kinds (bit 0 no PID, 1 header only, 2 truncated, 3 over-length, 4 framing error,
+//                 5 short break), bytes received, time (4 bytes, us), break length (4 bytes, us), the bytes (up to 11:
+//                 sync, PID, response)
+//record_suppressed: type, channel, id, frames held back by the limit of the id since its last report (4 bytes),
+//                 time of the last of them (4 bytes, us)
+//record_history: type, channel, id, data count, time of the first frame with the payload (4 bytes, us), frames in a row
+//                 with it (4 bytes), data. Channel 0 ends the history, the count is the number of payloads sent
+//channel is the LIN port (1 - Serial1, 2 - Serial2, 3 - Serial3) the frame was received on
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BIN_DELIMITER 0x00
+#define BIN_MAX_SIGNALS 8                            //signals in one record_signals
+#define BIN_MAX_DIAGNOSTIC 128                       //message bytes in one record_diagnostic
+#define BIN_MAX_RECORD (22 + BIN_MAX_DIAGNOSTIC + 1) //largest record before encoding: record_diagnostic with the CRC
+#define BIN_MAX_ENCODED (BIN_MAX_RECORD + BIN_MAX_RECORD / 254 + 2) //COBS overhead + delimiter
+
+enum record_type_t
+{
+    record_frame = 0x01,
+    record_new_loop = 0x02,
+    record_drops = 0x03,
+    record_stats = 0x04,
+    record_bus_stats = 0x05,
+    record_trigger = 0x06,
+    record_signals = 0x07,
+    record_schedule = 0x08,
+    record_diagnostic = 0x09,
+    record_malformed = 0x0A,
+    record_suppressed = 0x0B,
+    record_history = 0x0C
+};
+
+//flags of record_frame
+#define BIN_FLAG_NEW 0x01     //first frame with this id
+#define BIN_FLAG_CHANGED 0x02 //contents differ from the last frame with this id
+#define BIN_FLAG_PARITY_ERROR 0x04   //the PID parity is wrong, the frame is not compared
+#define BIN_FLAG_CHECKSUM_ERROR 0x08 //the checksum is wrong, the frame is not compared
+#define BIN_FLAG_TRIGGER 0x10        //a dumped frame: the one that fired the trigger
+
+//events of record_trigger
+#define BIN_TRIGGER_FIRED 1
+#define BIN_TRIGGER_END 2
+
+//events of record_schedule
+#define BIN_SCHEDULE_LEARNED 1  //a new table: count - slots, expected - cycle time
+#define BIN_SCHEDULE_SWITCHED 2 //back to a table learned before
+#define BIN_SCHEDULE_MISSING 3  //count slots from slot (with id) had no frame
+#define BIN_SCHEDULE_EXTRA 4    //a frame of id where the schedule has none
+#define BIN_SCHEDULE_JITTER 5   //measured - gap to the slot before, expected - its nominal gap
+#define BIN_SCHEDULE_LOST 6     //the frames no longer fit (or stopped for measured us), the schedule is learned anew
+
+//status of record_diagnostic
+#define BIN_DIAGNOSTIC_COMPLETE 0
+#define BIN_DIAGNOSTIC_SEQUENCE 1    //a consecutive frame out of sequence, the message ends before it
+#define BIN_DIAGNOSTIC_INTERRUPTED 2 //a new message or a damaged frame before the last frame
+#define BIN_DIAGNOSTIC_TIMEOUT 3     //the next frame did not come within 1 s
+#define BIN_DIAGNOSTIC_UNEXPECTED 4  //a frame that starts no message, data is the whole frame
+#define BIN_DIAGNOSTIC_SLEEP 5       //the go to sleep command
+
+namespace binary_protocol
+{
+    inline uint8_t crc8(const uint8_t *data, size_t length)
+    {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; ++bit)
+                crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+        return crc;
+    }
+
+    inline void putU32(uint8_t *out, uint32_t value)
+    {
+        out[0] = value;
+        out[1] = value >> 8;
+        out[2] = value >> 16;
+        out[3] = value >> 24;
+    }
+
+    inline void putU16(uint8_t *out, uint16_t value)
+    {
+        out[0] = value;
+        out[1] = value >> 8;
+    }
+
+    inline void putFloat(uint8_t *out, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        putU32(out, bits);
+    }
+
+    inline uint16_t getU16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+    inline uint32_t getU32(const uint8_t *in)
+    {
+        return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+
+    inline float getFloat(const uint8_t *in)
+    {
+        uint32_t bits = getU32(in);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    //COBS encodes length bytes and appends the delimiter, returns the number of bytes written to out
+    inline size_t encode(const uint8_t *in, size_t length, uint8_t *out)
+    {
+        size_t code_pos = 0;
+        size_t pos = 1;
+        uint8_t code = 1;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (in[i] == BIN_DELIMITER)
+            {
+                out[code_pos] = code;
+                code_pos = pos++;
+                code = 1;
+                continue;
+            }
+            out[pos++] = in[i];
+            if (++code == 0xFF)
+            {
+                out[code_pos] = code;
+                code_pos = pos++;
+                code = 1;
+            }
+        }
+        out[code_pos] = code;
+        out[pos++] = BIN_DELIMITER;
+        return pos;
+    }
+
+    //decodes one COBS block (without the delimiter), returns the decoded length or 0 if it is malformed
+    inline size_t decode(const uint8_t *in, size_t length, uint8_t *out, size_t out_size)
+    {
+        size_t pos = 0;
+        size_t out_pos = 0;
+        while (pos < length)
+        {
+            uint8_t code = in[pos++];
+            if (code == BIN_DELIMITER || pos + code - 1 > length)
+                return 0;
+            for (uint8_t i = 1; i < code; ++i)
+            {
+                if (out_pos == out_size)
+                    return 0;
+                out[out_pos++] = in[pos++];
+            }
+            if (code != 0xFF && pos < length)
+            {
+                if (out_pos == out_size)
+                    return 0;
+                out[out_pos++] = 0;
+            }
+        }
+        return out_pos;
+    }
+};
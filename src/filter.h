@@ -0,0 +1,382 @@
+#pragma once
+#include "LIN_handler.h"
+
+#define FILTER_MAX_OPS 32   //instructions of a compiled filter, also the depth of its stack
+#define FILTER_MAX_TEXT 64  //length of the expression kept for showing it
+#define FILTER_MAX_NESTING 8 //parentheses
+
+//report filter: an expression over the frame, compiled into postfix code when it is set.
+//
+//  expr    := and ("or" | "||") and ...
+//  and     := unary ("and" | "&&") unary ...
+//  unary   := ("not" | "!") unary | "(" expr ")" | test
+//  test    := field ["&" mask] compare | "chg" [byte ["&" mask]]
+//  compare := ("==" | "!=" | "<" | "<=" | ">" | ">=") value | "in" value ".." value
+//  field   := "id" | "ch" | "len" | "b0" ... "b7"
+//
+//Numbers are hexadecimal (channel and length as well). "chg" is true if the contents (or the masked bits of the byte)
+//differ from the last frame of the id. Tests of data bytes the frame does not have are false.
+//Every test is one instruction (lower <= (field & mask) <= upper), so checking a frame takes at most FILTER_MAX_OPS steps.
+enum filter_op_t
+{
+    filter_test = 0,
+    filter_and,
+    filter_or,
+    filter_not
+};
+
+enum filter_field_t
+{
+    field_id = 0,
+    field_channel,
+    field_length,
+    field_byte,         //data byte
+    field_changed_byte, //bits of the data byte that differ from the last frame
+    field_changed       //1 if the contents differ from the last frame
+};
+
+struct filter_instr
+{
+    uint8_t op;    //filter_op_t
+    uint8_t field; //filter_field_t
+    uint8_t index; //data byte
+    uint8_t mask;
+    uint8_t lower;
+    uint8_t upper;
+};
+
+class frame_filter
+{
+public:
+    bool active() const { return length != 0; }
+    const char *text() const { return source; }
+    uint8_t size() const { return length; }
+
+    void clear()
+    {
+        length = 0;
+        source[0] = '\0';
+    }
+
+    //compiles the expression, the filter is only replaced if it is correct. Otherwise error points to where it went wrong
+    bool compile(const char *expression)
+    {
+        input = expression;
+        pos = 0;
+        new_length = 0;
+        nesting = 0;
+        failed = false;
+        next();
+        parseOr();
+        if (token != token_end)
+            failed = true;
+        if (failed)
+        {
+            error = input + token_start;
+            return false;
+        }
+        memcpy(program, new_program, sizeof(program));
+        length = new_length;
+        strncpy(source, expression, FILTER_MAX_TEXT - 1);
+        source[FILTER_MAX_TEXT - 1] = '\0';
+        return true;
+    }
+
+    //old is the last frame of the id (nullptr for the first one)
+    bool match(const data_frame &frame, const data_frame *old) const
+    {
+        uint32_t stack = 0; //one bit per value, the top is bit 0
+        for (uint8_t i = 0; i < length; ++i)
+        {
+            const filter_instr &in = program[i];
+            switch (in.op)
+            {
+            case filter_test:
+                stack = stack << 1 | test(in, frame, old);
+                break;
+            case filter_and:
+                stack = (stack >> 2) << 1 | (stack & (stack >> 1) & 1);
+                break;
+            case filter_or:
+                stack = (stack >> 2) << 1 | ((stack | (stack >> 1)) & 1);
+                break;
+            case filter_not:
+                stack ^= 1;
+                break;
+            }
+        }
+        return stack & 1;
+    }
+
+    const char *error = nullptr;
+
+private:
+    enum token_t
+    {
+        token_end = 0,
+        token_word,   //letters and digits
+        token_symbol, //operators and parentheses
+        token_bad
+    };
+
+    static bool test(const filter_instr &in, const data_frame &frame, const data_frame *old)
+    {
+        uint8_t value;
+        switch (in.field)
+        {
+        case field_id:
+            value = frame.id;
+            break;
+        case field_channel:
+            value = frame.channel;
+            break;
+        case field_length:
+            value = frame.data_count;
+            break;
+        case field_byte:
+            if (in.index >= frame.data_count)
+                return false;
+            value = frame.data[in.index];
+            break;
+        case field_changed_byte:
+            if (in.index >= frame.data_count)
+                return false;
+            value = old ? frame.data[in.index] ^ old->data[in.index] : 0xFF;
+            break;
+        default:
+            value = !old || old->data_count != frame.data_count || old->chk != frame.chk ||
+                    memcmp(old->data, frame.data, sizeof(frame.data)) != 0;
+            break;
+        }
+        value &= in.mask;
+        return value >= in.lower && value <= in.upper;
+    }
+
+    //tokenizer
+    void next()
+    {
+        while (input[pos] == ' ')
+            ++pos;
+        token_start = pos;
+        token_length = 0;
+        char c = input[pos];
+        if (c == '\0')
+            token = token_end;
+        else if (isalnum(c))
+        {
+            token = token_word;
+            while (isalnum(input[pos + token_length]))
+                ++token_length;
+        }
+        else
+        {
+            //two character operators first
+            static const char *const symbols[] = {"==", "!=", "<=", ">=", "&&", "||", "..", "<", ">", "&", "!", "(", ")"};
+            token = token_bad;
+            for (const char *symbol : symbols)
+            {
+                uint8_t len = strlen(symbol);
+                if (!strncmp(input + pos, symbol, len))
+                {
+                    token = token_symbol;
+                    token_length = len;
+                    break;
+                }
+            }
+        }
+        pos += token_length;
+    }
+
+    bool is(const char *text) const
+    {
+        return token != token_end && strlen(text) == token_length && !strncmp(input + token_start, text, token_length);
+    }
+
+    //takes the token if it is the text
+    bool accept(const char *text)
+    {
+        if (!is(text))
+            return false;
+        next();
+        return true;
+    }
+
+    bool number(uint8_t &value)
+    {
+        if (token != token_word || token_length > 2)
+            return fail();
+        uint8_t result = 0;
+        for (uint8_t i = 0; i < token_length; ++i)
+        {
+            char c = input[token_start + i];
+            if (!isxdigit(c))
+                return fail();
+            result = result * 16 + (isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        value = result;
+        next();
+        return true;
+    }
+
+    //b0 ... b7
+    bool dataByte(uint8_t &index)
+    {
+        if (token != token_word || token_length != 2 || input[token_start] != 'b' || input[token_start + 1] < '0' || input[token_start + 1] > '7')
+            return false;
+        index = input[token_start + 1] - '0';
+        next();
+        return true;
+    }
+
+    bool fail()
+    {
+        failed = true;
+        return false;
+    }
+
+    void emit(uint8_t op, uint8_t field = 0, uint8_t index = 0, uint8_t mask = 0, uint8_t lower = 0, uint8_t upper = 0)
+    {
+        if (new_length == FILTER_MAX_OPS)
+        {
+            fail();
+            return;
+        }
+        new_program[new_length++] = {op, field, index, mask, lower, upper};
+    }
+
+    void parseOr()
+    {
+        parseAnd();
+        while (!failed && (accept("or") || accept("||")))
+        {
+            parseAnd();
+            emit(filter_or);
+        }
+    }
+
+    void parseAnd()
+    {
+        parseUnary();
+        while (!failed && (accept("and") || accept("&&")))
+        {
+            parseUnary();
+            emit(filter_and);
+        }
+    }
+
+    void parseUnary()
+    {
+        if (accept("not") || accept("!"))
+        {
+            parseUnary();
+            emit(filter_not);
+        }
+        else if (accept("("))
+        {
+            if (++nesting > FILTER_MAX_NESTING)
+            {
+                fail();
+                return;
+            }
+            parseOr();
+            --nesting;
+            if (!failed && !accept(")"))
+                fail();
+        }
+        else
+            parseTest();
+    }
+
+    void parseTest()
+    {
+        uint8_t field, index = 0, mask = 0xFF;
+        if (accept("chg"))
+        {
+            //without a byte: any change of the contents
+            if (!dataByte(index))
+            {
+                emit(filter_test, field_changed, 0, 0xFF, 1, 1);
+                return;
+            }
+            if (accept("&") && !number(mask))
+                return;
+            emit(filter_test, field_changed_byte, index, mask, 1, 0xFF);
+            return;
+        }
+        if (accept("id"))
+            field = field_id;
+        else if (accept("ch"))
+            field = field_channel;
+        else if (accept("len"))
+            field = field_length;
+        else if (dataByte(index))
+            field = field_byte;
+        else
+        {
+            fail();
+            return;
+        }
+        if (accept("&") && !number(mask))
+            return;
+        uint8_t value, upper;
+        if (accept("in"))
+        {
+            if (!number(value) || !accept("..") || !number(upper) || value > upper)
+            {
+                fail();
+                return;
+            }
+            emit(filter_test, field, index, mask, value, upper);
+        }
+        else if (accept("=="))
+        {
+            if (number(value))
+                emit(filter_test, field, index, mask, value, value);
+        }
+        else if (accept("!="))
+        {
+            if (number(value))
+            {
+                emit(filter_test, field, index, mask, value, value);
+                emit(filter_not);
+            }
+        }
+        else if (accept("<="))
+        {
+            if (number(value))
+                emit(filter_test, field, index, mask, 0, value);
+        }
+        else if (accept(">="))
+        {
+            if (number(value))
+                emit(filter_test, field, index, mask, value, 0xFF);
+        }
+        else if (accept("<"))
+        {
+            //nothing is below 0: an empty range
+            if (number(value))
+                emit(filter_test, field, index, mask, value ? 0 : 1, value ? value - 1 : 0);
+        }
+        else if (accept(">"))
+        {
+            if (number(value))
+                emit(filter_test, field, index, mask, value < 0xFF ? value + 1 : 1, value < 0xFF ? 0xFF : 0);
+        }
+        else
+            fail();
+    }
+
+    filter_instr program[FILTER_MAX_OPS];
+    uint8_t length = 0;
+    char source[FILTER_MAX_TEXT] = "";
+    //compiler state
+    filter_instr new_program[FILTER_MAX_OPS];
+    uint8_t new_length;
+    const char *input;
+    uint8_t pos;
+    uint8_t token_start;
+    uint8_t token_length;
+    token_t token;
+    uint8_t nesting;
+    bool failed;
+};
@@ -0,0 +1,230 @@
+#pragma once
+#include "LIN_handler.h"
+
+//every id keeps the payloads it had, oldest first, in a ring of bytes of its own. A payload is stored as the difference
+//to the one before it: a header, the time since it, the data bytes that changed and how often it came in a row.
+//The oldest payloads make room for the new ones, so an id holds about 15 to 40 of them depending on how much they change
+#define HISTORY_RING_SIZE 128 //bytes of every id, 64 ids take about 12 KB with their state
+#define HISTORY_MAX_ENTRY 20  //header, time (5), mask, 8 data bytes, repeats (5)
+
+#define HISTORY_COUNT_MASK 0x0F    //header: data count
+#define HISTORY_CHANNEL_SHIFT 4    //header: channel in bits 4 and 5
+#define HISTORY_REPEATED 0x40      //header: the repeats follow the data
+
+//a payload of an id: the first frame that had it and how many frames in a row did
+struct history_entry
+{
+    uint32_t time;  //us, of the first frame
+    uint32_t count; //frames in a row with the payload
+    uint8_t channel;
+    uint8_t data_count;
+    uint8_t data[8];
+};
+
+//the history of an id
+struct history_ring
+{
+    history_entry anchor; //the payload before the oldest one in bytes, the oldest is stored as the difference to it
+    history_entry last;   //the newest payload in bytes, the next is stored as the difference to it
+    history_entry open;   //the newest payload, still counted, valid if count is not 0
+    uint8_t bytes[HISTORY_RING_SIZE];
+    uint8_t start;   //of the oldest payload in bytes
+    uint8_t used;    //bytes
+    uint8_t entries; //payloads in bytes
+
+    //the payload stored at pos as the difference to state, which becomes the payload. Returns the bytes it took
+    uint8_t decode(uint8_t pos, history_entry &state) const
+    {
+        uint8_t begin = pos;
+        uint8_t header = get(pos);
+        state.channel = header >> HISTORY_CHANNEL_SHIFT & 0x03;
+        state.data_count = header & HISTORY_COUNT_MASK;
+        state.time += getVarint(pos);
+        if (state.data_count)
+        {
+            uint8_t mask = get(pos);
+            for (uint8_t i = 0; i < state.data_count; ++i)
+                if (mask >> i & 1)
+                    state.data[i] = get(pos);
+        }
+        state.count = header & HISTORY_REPEATED ? getVarint(pos) + 1 : 1;
+        return (uint8_t)(pos - begin + HISTORY_RING_SIZE) % HISTORY_RING_SIZE;
+    }
+
+private:
+    uint8_t get(uint8_t &pos) const
+    {
+        uint8_t byte = bytes[pos];
+        pos = pos + 1 == HISTORY_RING_SIZE ? 0 : pos + 1;
+        return byte;
+    }
+
+    uint32_t getVarint(uint8_t &pos) const
+    {
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t byte = get(pos);
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return value;
+    }
+};
+
+//the histories of all ids, fed with every valid frame of every bus. A frame with the payload of the frame before it
+//(same bus, length and data) only counts, others close the open payload and store it
+class history_log
+{
+public:
+    void clear() { memset(rings, 0, sizeof(rings)); }
+
+    void record(const data_frame &frame)
+    {
+        history_ring &ring = rings[frame.id];
+        history_entry &open = ring.open;
+        if (open.count && open.channel == frame.channel && open.data_count == frame.data_count &&
+            !memcmp(open.data, frame.data, frame.data_count))
+        {
+            ++open.count;
+            return;
+        }
+        if (open.count)
+            store(ring);
+        open.time = frame.time;
+        open.count = 1;
+        open.channel = frame.channel;
+        open.data_count = frame.data_count;
+        memcpy(open.data, frame.data, sizeof(open.data));
+    }
+
+    const history_ring &ring(uint8_t id) const { return rings[id]; }
+
+    //payloads held by the id, with the open one
+    uint8_t payloads(uint8_t id) const { return rings[id].entries + (rings[id].open.count ? 1 : 0); }
+
+private:
+    //the open payload goes into bytes as the difference to the last one, the oldest make room for it
+    void store(history_ring &ring)
+    {
+        const history_entry &open = ring.open;
+        history_entry &last = ring.last;
+        uint8_t entry[HISTORY_MAX_ENTRY];
+        uint8_t length = 1;
+        entry[0] = open.data_count | open.channel << HISTORY_CHANNEL_SHIFT | (open.count > 1 ? HISTORY_REPEATED : 0);
+        length = putVarint(entry, length, open.time - last.time);
+        if (open.data_count)
+        {
+            uint8_t mask_at = length++;
+            uint8_t mask = 0;
+            for (uint8_t i = 0; i < open.data_count; ++i)
+                if (open.data[i] != last.data[i])
+                {
+                    mask |= 1 << i;
+                    entry[length++] = open.data[i];
+                }
+            entry[mask_at] = mask;
+        }
+        if (open.count > 1)
+            length = putVarint(entry, length, open.count - 1);
+        while (HISTORY_RING_SIZE - ring.used < length)
+        {
+            uint8_t oldest = ring.decode(ring.start, ring.anchor);
+            ring.start = (ring.start + oldest) % HISTORY_RING_SIZE;
+            ring.used -= oldest;
+            --ring.entries;
+        }
+        uint8_t pos = (ring.start + ring.used) % HISTORY_RING_SIZE;
+        for (uint8_t i = 0; i < length; ++i)
+        {
+            ring.bytes[pos] = entry[i];
+            pos = pos + 1 == HISTORY_RING_SIZE ? 0 : pos + 1;
+        }
+        ring.used += length;
+        ++ring.entries;
+        last.time = open.time;
+        last.channel = open.channel;
+        last.data_count = open.data_count;
+        for (uint8_t i = 0; i < open.data_count; ++i)
+            last.data[i] = open.data[i];
+    }
+
+    static uint8_t putVarint(uint8_t *entry, uint8_t length, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            entry[length++] = value | 0x80;
+            value >>= 7;
+        }
+        entry[length++] = value;
+        return length;
+    }
+
+    history_ring rings[LIN_MEM_SIZE];
+};
+
+//reads the payloads of a range of ids back, oldest first. The history of an id is copied before it is read,
+//so the frames recorded meanwhile do not disturb it
+class history_reader
+{
+public:
+    bool active = false; //payloads are being read
+    uint16_t sent;       //payloads read since start()
+
+    void start(uint8_t first, uint8_t last)
+    {
+        next_id = first;
+        last_id = last;
+        loaded = false;
+        active = true;
+        sent = 0;
+    }
+
+    //the next payload and its id, false once every id was read
+    bool next(const history_log &log, uint8_t &id, history_entry &entry)
+    {
+        while (true)
+        {
+            if (loaded)
+            {
+                id = next_id - 1;
+                if (left)
+                {
+                    uint8_t length = copy.decode(pos, state);
+                    pos = (pos + length) % HISTORY_RING_SIZE;
+                    --left;
+                    entry = state;
+                    ++sent;
+                    return true;
+                }
+                loaded = false;
+                if (copy.open.count)
+                {
+                    entry = copy.open;
+                    ++sent;
+                    return true;
+                }
+            }
+            if (next_id > last_id)
+            {
+                active = false;
+                return false;
+            }
+            copy = log.ring(next_id++);
+            state = copy.anchor;
+            pos = copy.start;
+            left = copy.entries;
+            loaded = true;
+        }
+    }
+
+private:
+    history_ring copy;
+    history_entry state; //the payload decoded last
+    uint8_t pos;
+    uint8_t left; //payloads in copy.bytes not read
+    uint8_t next_id;
+    uint8_t last_id;
+    bool loaded; //copy is being read
+};
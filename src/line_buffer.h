@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+//longest line: a diagnostic message (BIN_MAX_DIAGNOSTIC bytes), the changed signals of an id are shorter
+#define LINE_BUFFER_SIZE 512
+
+//nibble lookup for hex formatting
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+//preallocated text line, filled without any heap allocation and sent in one write
+struct line_buffer
+{
+    char text[LINE_BUFFER_SIZE];
+    uint16_t length = 0;
+
+    void clear() { length = 0; }
+    void put(const char c) { text[length++] = c; }
+    //string constants (e.g. color codes) - the length is known at compile time
+    template <size_t N>
+    void put(const char (&str)[N])
+    {
+        memcpy(text + length, str, N - 1);
+        length += N - 1;
+    }
+    void putHex(const uint8_t byte)
+    {
+        text[length++] = HEX_DIGITS[byte >> 4];
+        text[length++] = HEX_DIGITS[byte & 0x0F];
+    }
+    //right aligned to width with spaces
+    void putDec(uint32_t value, uint8_t width = 0)
+    {
+        char digits[10];
+        uint8_t count = 0;
+        do
+        {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (width > count)
+        {
+            text[length++] = ' ';
+            --width;
+        }
+        while (count)
+            text[length++] = digits[--count];
+    }
+};
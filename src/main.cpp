@@ -1,10 +1,25 @@
-#include "Arduino.h"
+#include "LIN_hal.h"
 #include "LIN_handler.h"
-#include "DueFlashStorage.h"
+#include "binary_protocol.h"
+#include "line_buffer.h"
+#include "output_queue.h"
+#include "statistics.h"
+#include "trigger.h"
+#include "filter.h"
+#include "signals.h"
+#include "signal_table.h"
+#include "schedule.h"
+#include "transport.h"
+#include "settings.h"
+#include "scheduler.h"
+#include "table_view.h"
+#include "rate_limit.h"
+#include "history.h"
 
 #define BUFFER_SIZE 200
 
 #define SERIAL_BAUD 115200 //the baudrate used when communicating with a computer
+#define MALFORMED_FRAMES 16 //malformed frames waiting for the host serial port, all buses. Has to be a power of two
 
 //message clr
 #define C_RED "\e[1;31m"
@@ -21,73 +36,185 @@ enum frame_option_t
     option_always
 };
 
+enum output_mode_t
+{
+    output_text = 0,
+    output_binary
+};
+
+enum schedule_mode_t
+{
+    schedule_off = 0,
+    schedule_on,  //anomalies of the schedule are reported between the frames
+    schedule_only //only the anomalies (and frames with errors) are reported
+};
+
+enum view_t
+{
+    view_stream = 0, //a line per reported frame
+    view_table       //a row per id, updated in place (text output only)
+};
+
 struct config_t
 {
     frame_option_t frame_verbosity[LIN_MEM_SIZE];
     bool stub;
-    long baudrate;
+    long baudrate; //of channel 1
     bool clr;
     bool chk;
+    long idle_bits;
+    output_mode_t output;
+    overflow_policy_t overflow;
+    bool timestamps;
+    bool autobaud[LIN_CHANNELS];
+    long other_baudrates[LIN_CHANNELS - 1]; //of channels 2 and 3
+    long stats_period; //seconds between the periodic statistics records, 0 - off
+    bool decode;       //ids with signals report the signals that changed instead of the frame
+    schedule_mode_t schedule;
+    long schedule_tolerance; //percent of the nominal gap
+    bool transport;          //diagnostic frames are reassembled into messages
+    bool malformed_dump;     //the raw bytes of malformed frames are reported
+    view_t view;
+    long view_refresh; //ms between the updates of the table view
+    id_limit limits[LIN_MEM_SIZE];
 };
 
+static_assert(BIN_MAX_ENCODED <= LINE_BUFFER_SIZE, "a record has to fit the line");
+
 config_t config; //configuration of the sniffer
 bool if_newlined = true;
-DueFlashStorage dueFlashStorage;
+line_buffer line;      //the report of a frame is put together here
+uint16_t line_sent;    //how much of the line the host serial port has taken
+//a command waits until the line being sent is complete, so its reply does not split a report (or a record)
+char command_buffer[BUFFER_SIZE];
+bool command_waiting = false;
+output_queue reports;  //decoded frames waiting for the host serial port
+uint32_t reported_dropped, reported_coalesced; //counters of the queue at the last drop report
+
+//one sniffer per LIN port, serviced in turn by loop()
+lin_sniffer<1> bus1;
+lin_sniffer<2> bus2;
+lin_sniffer<3> bus3;
+lin_bus *const buses[LIN_CHANNELS] = {&bus1, &bus2, &bus3};
+
+run_stats stats(buses, reports);
+stats_t stats_result;  //the last finished statistics period
+uint8_t stats_pending; //records of stats_result still to be sent
+
+//while triggers are set, frames are only captured and dumped around the triggers
+trigger_engine triggers;
+frame_filter filter; //reports only the frames matching it, on top of the verbosity of their id
+signal_db signals;   //decoded into physical values if config.decode is set
+
+//the schedule table of every bus, learned from the frames
+schedule_monitor schedules[LIN_CHANNELS];
+ring_buffer<schedule_event, SCHEDULE_EVENTS> schedule_events;
+
+//the diagnostic messages of every bus, reassembled from the frames
+tp_reassembler transports[LIN_CHANNELS];
+ring_buffer<tp_message, TP_MESSAGES> diagnostic_messages;
+
+const char *const MALFORMED_NAMES[MALFORMED_KINDS] = {"no PID", "header only", "truncated", "over-length", "framing error", "short break"};
+ring_buffer<malformed_frame, MALFORMED_FRAMES> malformed_frames;
+
+//the frames held back by the limits of their ids
+rate_limiter limiter;
+
+//the payloads every id had, read back with history and dump
+history_log history;
+history_reader history_dump;
+
+//the rows of the ids, drawn instead of the reports in the table view
+table_view table;
+
+//loop() runs the reception and one of the other tasks in turn, see setup()
+task_scheduler scheduler;
+
+//the settings and signals in flash, written a page at a time while the buses are between frames
+settings_store<config_t> settings;
+unsigned long settings_wait;                //the last page was written (or the save started)
+settings_step_t settings_result = settings_idle; //end of the last save, waiting for the host serial port
 
 void saveSettings()
 {
-    byte mem[sizeof(config_t)];
-    memcpy(mem, &config, sizeof(config_t));
-    dueFlashStorage.write(4, mem, sizeof(config_t)); // write byte array to flash
-    if (dueFlashStorage.read(0) != 0)
-        dueFlashStorage.write(0, 0);
+    settings.save(config, signals);
+    settings_wait = hal::timestamp();
+}
+
+//whether no bus is receiving a frame, so the loop can be away for a flash page
+bool busesIdle()
+{
+    for (lin_bus *bus : buses)
+        if (!bus->idle())
+            return false;
+    return true;
 }
 
 void startSniffing()
 {
-    LIN_sniffer::LIN_state = initialize;
+    for (lin_bus *bus : buses)
+        bus->LIN_state = initialize;
 }
 
 void stopSniffing()
 {
-    detachInterrupt(LIN_RX);
-    LIN_sniffer::reset();
+    for (lin_bus *bus : buses)
+        bus->reset();
 }
 
 void setColor(const char *color)
 {
     if (config.clr)
-        Serial.print(color);
+        HostSerial.print(color);
 }
 
-String HexToString(const uint8_t byte, const bool leading_zero = true)
+template <size_t N>
+void setColor(line_buffer &out, const char (&color)[N])
 {
-    String temp = "";
-    if (leading_zero && byte <= 0x0F)
-        temp += "0";
-    temp += String(byte, HEX);
-    return temp;
+    if (config.clr)
+        out.put(color);
 }
 
-String frameToString(const data_frame frame, const bool if_chk = true)
+void printHex(const uint8_t byte)
 {
-    String out = HexToString(frame.id) + " | ";
-    for (int i = 0; i < frame.data_count; ++i)
-        out += String(frame.data[i], HEX) + " ";
-    if (if_chk)
-        out += "(" + String(frame.chk, HEX) + ")";
-    return out;
+    const char hex[2] = {HEX_DIGITS[byte >> 4], HEX_DIGITS[byte & 0x0F]};
+    HostSerial.write((const uint8_t *)hex, 2);
+}
+
+//the bus is restarted with the new setting if it is running
+void setBaudrate(const uint8_t channel, const long baud)
+{
+    lin_bus *bus = buses[channel - 1];
+    if (channel == 1)
+        config.baudrate = baud;
+    else
+        config.other_baudrates[channel - 2] = baud;
+    bool on = (bus->LIN_state != stopped);
+    if (on)
+        bus->reset();
+    bus->setBaud(baud);
+    if (on)
+        bus->LIN_state = initialize;
 }
 
-void setBaudrate(const long baud)
+//the baudrate set before is the first guess
+void setAutobaud(const uint8_t channel, const bool state)
 {
-    config.baudrate = baud;
-    bool on = (LIN_sniffer::LIN_state != stopped);
+    lin_bus *bus = buses[channel - 1];
+    config.autobaud[channel - 1] = state;
+    bool on = (bus->LIN_state != stopped);
     if (on)
-        stopSniffing();
-    LIN_sniffer::LIN_BAUD = baud;
+        bus->reset();
+    bus->LIN_AUTOBAUD = state;
     if (on)
-        startSniffing();
+        bus->LIN_state = initialize;
+}
+
+void setIdleBits(const long bits)
+{
+    config.idle_bits = bits;
+    for (lin_bus *bus : buses)
+        bus->setIdleBits(bits);
 }
 
 void setFrameOption(const uint8_t id, const frame_option_t option)
@@ -105,75 +232,246 @@ void setChk(bool state)
     config.chk = state;
 }
 
+void setTimestamps(bool state)
+{
+    config.timestamps = state;
+}
+
 void setColoring(bool state)
 {
     config.clr = state;
 }
 
-void MarkNewLoop(uint8_t frame)
+void setOutput(output_mode_t mode)
+{
+    config.output = mode;
+}
+
+//the table view starts on a cleared screen, the reports queued for the stream are dropped
+void setView(view_t view)
+{
+    if (view == view_table)
+    {
+        table.start();
+        reports.clear();
+    }
+    config.view = view;
+}
+
+void setViewRefresh(long ms)
+{
+    config.view_refresh = ms;
+    table.refresh = ms * 1000UL;
+}
+
+//the counts of the limits start over
+void setLimit(uint8_t id, const id_limit &limit)
+{
+    config.limits[id] = limit;
+    limiter.clear();
+}
+
+void setOverflow(overflow_policy_t policy)
+{
+    config.overflow = policy;
+}
+
+void setStatsPeriod(long seconds)
+{
+    config.stats_period = seconds;
+    stats.period_ms = seconds * 1000;
+}
+
+void setDecode(bool state)
+{
+    config.decode = state;
+}
+
+//the schedules are learned anew when the monitoring is turned on
+void setSchedule(schedule_mode_t mode)
+{
+    if (config.schedule == schedule_off && mode != schedule_off)
+        for (schedule_monitor &monitor : schedules)
+            monitor.clear();
+    config.schedule = mode;
+}
+
+void setTransport(bool state)
+{
+    for (lin_bus *bus : buses)
+        bus->LIN_TRANSPORT = state;
+    for (tp_reassembler &transport : transports)
+        transport.clear();
+    config.transport = state;
+}
+
+void setMalformedDump(bool state)
+{
+    config.malformed_dump = state;
+}
+
+void setScheduleTolerance(long percent)
+{
+    config.schedule_tolerance = percent;
+    for (schedule_monitor &monitor : schedules)
+        monitor.tolerance = percent;
+}
+
+//in binary mode text is ended with a delimiter, so it is not mistaken for the start of a record
+void endText()
+{
+    if (config.output == output_binary)
+        HostSerial.write((uint8_t)BIN_DELIMITER);
+}
+
+//whether a frame produces any output according to the filter and its verbosity (binary mode has no stubs).
+//old is the last frame of the id, if there is one
+bool isReported(const report_kind_t kind, const data_frame &frame, const data_frame *old)
+{
+    if (config.view == view_table)
+        return false;
+    if (config.schedule == schedule_only && kind != report_error)
+        return false;
+    if (filter.active() && !filter.match(frame, old))
+        return false;
+    frame_option_t option = config.frame_verbosity[frame.id];
+    if (option == option_always || (option != option_never && kind != report_unchanged))
+        return true;
+    return config.output == output_text && config.stub;
+}
+
+//whether the frame is reported as the signals that changed
+bool isDecoded(const data_frame &frame)
+{
+    return config.decode && config.frame_verbosity[frame.id] != option_never && signals.has(frame.channel, frame.id);
+}
+
+//time of the break falling edge in front of a reported line, microseconds
+void putTime(unsigned long time)
+{
+    if (!config.timestamps)
+        return;
+    line.putDec(time, 10);
+    line.put(' ');
+}
+
+//the LIN port in front of the id
+void putChannel(uint8_t channel)
+{
+    line.put('0' + channel);
+    line.put(':');
+}
+
+void sendRecord(uint8_t *record, const uint8_t length)
+{
+    record[length] = binary_protocol::crc8(record, length);
+    line.length = binary_protocol::encode(record, length + 1, (uint8_t *)line.text);
+}
+
+void sendFrameRecord(const data_frame &frame, const uint8_t flags)
+{
+    uint8_t record[BIN_MAX_RECORD];
+    record[0] = record_frame;
+    record[1] = flags;
+    record[2] = frame.channel;
+    record[3] = frame.id;
+    record[4] = frame.data_count;
+    binary_protocol::putU32(record + 5, frame.time);
+    memcpy(record + 9, frame.data, frame.data_count);
+    record[9 + frame.data_count] = frame.chk;
+    sendRecord(record, 10 + frame.data_count);
+}
+
+void printNewLoop(uint8_t channel, uint8_t frame, unsigned long time)
 {
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_new_loop;
+        record[1] = channel;
+        record[2] = frame;
+        binary_protocol::putU32(record + 3, time);
+        sendRecord(record, 7);
+        return;
+    }
     if (!if_newlined)
-        Serial.print('\n');
-    setColor(C_YLW);
-    Serial.print("NL: ");
+        line.put('\n');
+    setColor(line, C_YLW);
+    putTime(time);
+    putChannel(channel);
+    line.put("NL: ");
     if_newlined = false;
-    setColor(C_RST);
+    setColor(line, C_RST);
 }
 
-void MarkNewFrame(data_frame &frame)
+void printNewFrame(const data_frame &frame)
 {
+    if (config.output == output_binary)
+    {
+        sendFrameRecord(frame, BIN_FLAG_NEW);
+        return;
+    }
     switch (config.frame_verbosity[frame.id])
     {
     case option_never:
         //just the stub
         if (config.stub)
         {
-            setColor(C_GRN);
-            Serial.print(HexToString(frame.id));
-            Serial.print("/ ");
-            setColor(C_RST);
+            setColor(line, C_GRN);
+            putChannel(frame.channel);
+            line.putHex(frame.id);
+            line.put("/ ");
+            setColor(line, C_RST);
             if_newlined = false;
         }
         break;
     case option_change:
     case option_undefined:
     case option_always:
-        setColor(C_GRN);
+        setColor(line, C_GRN);
         if (!if_newlined)
-            Serial.print('\n');
-        Serial.print(HexToString(frame.id));
-        Serial.print(" | ");
+            line.put('\n');
+        putTime(frame.time);
+        putChannel(frame.channel);
+        line.putHex(frame.id);
+        line.put(" | ");
         for (int i = 0; i < frame.data_count; ++i)
         {
-            Serial.print(HexToString(frame.data[i]));
-            Serial.print(' ');
+            line.putHex(frame.data[i]);
+            line.put(' ');
         }
         if (config.chk)
         {
-            Serial.print('(');
-            Serial.print(HexToString(frame.chk));
-            Serial.println(')');
+            line.put('(');
+            line.putHex(frame.chk);
+            line.put(")\r\n");
         }
         else
-            Serial.print('\n');
-        setColor(C_RST);
+            line.put('\n');
+        setColor(line, C_RST);
         if_newlined = true;
         break;
     }
 }
 
-void MarkChangedFrame(data_frame &frame, data_frame *old_frame)
+void printChangedFrame(const data_frame &frame, const data_frame *old_frame)
 {
+    if (config.output == output_binary)
+    {
+        sendFrameRecord(frame, BIN_FLAG_CHANGED);
+        return;
+    }
     switch (config.frame_verbosity[frame.id])
     {
     case option_never:
         //just the stub
         if (config.stub)
         {
-            setColor(C_BLU);
-            Serial.print(HexToString(frame.id));
-            Serial.print("/ ");
-            setColor(C_RST);
+            setColor(line, C_BLU);
+            putChannel(frame.channel);
+            line.putHex(frame.id);
+            line.put("/ ");
+            setColor(line, C_RST);
             if_newlined = false;
         }
         break;
@@ -181,46 +479,51 @@ void MarkChangedFrame(data_frame &frame, data_frame *old_frame)
     case option_undefined:
     case option_always:
         if (!if_newlined)
-            Serial.print('\n');
-        Serial.print(HexToString(frame.id));
-        Serial.print(" | ");
+            line.put('\n');
+        putTime(frame.time);
+        putChannel(frame.channel);
+        line.putHex(frame.id);
+        line.put(" | ");
         for (int i = 0; i < frame.data_count; ++i)
         {
             if (frame.data[i] != old_frame->data[i])
             {
-                setColor(C_BLU);
-                Serial.print(HexToString(frame.data[i]));
-                setColor(C_RST);
+                setColor(line, C_BLU);
+                line.putHex(frame.data[i]);
+                setColor(line, C_RST);
             }
             else
-            {
-                Serial.print(HexToString(frame.data[i]));
-            }
-            Serial.print(' ');
+                line.putHex(frame.data[i]);
+            line.put(' ');
         }
         if (config.chk)
         {
-            Serial.print('(');
+            line.put('(');
             if (frame.chk != old_frame->chk)
             {
-                setColor(C_BLU);
-                Serial.print(HexToString(frame.chk));
-                setColor(C_RST);
+                setColor(line, C_BLU);
+                line.putHex(frame.chk);
+                setColor(line, C_RST);
             }
             else
-                Serial.print(HexToString(frame.chk));
-            Serial.println(')');
+                line.putHex(frame.chk);
+            line.put(")\r\n");
         }
         else
-            Serial.print('\n');
-        setColor(C_RST);
+            line.put('\n');
+        setColor(line, C_RST);
         if_newlined = true;
         break;
     }
 }
 
-void MarkUnchangedFrame(data_frame &frame)
+void printUnchangedFrame(const data_frame &frame)
 {
+    if (config.output == output_binary)
+    {
+        sendFrameRecord(frame, 0);
+        return;
+    }
     switch (config.frame_verbosity[frame.id])
     {
     case option_never:
@@ -229,182 +532,1837 @@ void MarkUnchangedFrame(data_frame &frame)
         //just the stub
         if (config.stub)
         {
-            Serial.print(HexToString(frame.id));
-            Serial.print("/ ");
+            putChannel(frame.channel);
+            line.putHex(frame.id);
+            line.put("/ ");
             if_newlined = false;
         }
         break;
 
     case option_always:
         if (!if_newlined)
-            Serial.print('\n');
-        Serial.print(HexToString(frame.id));
-        Serial.print(" | ");
+            line.put('\n');
+        putTime(frame.time);
+        putChannel(frame.channel);
+        line.putHex(frame.id);
+        line.put(" | ");
         for (int i = 0; i < frame.data_count; ++i)
         {
-            Serial.print(HexToString(frame.data[i]));
-            Serial.print(' ');
+            line.putHex(frame.data[i]);
+            line.put(' ');
         }
         if (config.chk)
         {
-            Serial.print('(');
-            Serial.print(HexToString(frame.chk));
-            Serial.println(')');
+            line.put('(');
+            line.putHex(frame.chk);
+            line.put(")\r\n");
         }
         else
-            Serial.print('\n');
+            line.put('\n');
         if_newlined = true;
         break;
     }
 }
 
-bool getCommand(char *buffer)
+void printErrorFrame(const data_frame &frame)
 {
-    static uint8_t cmd_buf[BUFFER_SIZE];
-    static uint8_t pos = 0;
-    while (Serial.available())
+    if (config.output == output_binary)
     {
-        char c = Serial.read();
-        cmd_buf[pos++] = c;
-        if (c == '\r' || c == '\n')
+        sendFrameRecord(frame, frame.status == frame_parity_error ? BIN_FLAG_PARITY_ERROR : BIN_FLAG_CHECKSUM_ERROR);
+        return;
+    }
+    if (config.frame_verbosity[frame.id] == option_never)
+    {
+        //just the stub
+        if (config.stub)
         {
-            cmd_buf[pos - 1] = '\0';
-            pos = 0;
-            strcpy(buffer, (char *)cmd_buf);
-            return true;
+            setColor(line, C_RED);
+            putChannel(frame.channel);
+            line.putHex(frame.id);
+            line.put("/ ");
+            setColor(line, C_RST);
+            if_newlined = false;
         }
-        //overflow protection
-        if (pos == BUFFER_SIZE)
+        return;
+    }
+    //the checksum is always shown, it is what is wrong with the frame
+    setColor(line, C_RED);
+    if (!if_newlined)
+        line.put('\n');
+    putTime(frame.time);
+    putChannel(frame.channel);
+    line.putHex(frame.id);
+    line.put(" | ");
+    for (int i = 0; i < frame.data_count; ++i)
+    {
+        line.putHex(frame.data[i]);
+        line.put(' ');
+    }
+    line.put('(');
+    line.putHex(frame.chk);
+    if (frame.status == frame_parity_error)
+        line.put(") parity error\r\n");
+    else
+        line.put(") checksum error\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+}
+
+//a physical value with the given decimals, the magnitude is limited to what fits into 32 bits
+void putFixed(float value, uint8_t decimals)
+{
+    static const uint32_t powers[SIGNAL_DECIMALS + 1] = {1, 10, 100, 1000};
+    if (value < 0)
+    {
+        line.put('-');
+        value = -value;
+    }
+    float scaled = value * powers[decimals] + 0.5f;
+    uint32_t fixed = scaled < 4294967295.0f ? (uint32_t)scaled : 4294967295u;
+    line.putDec(fixed / powers[decimals]);
+    if (!decimals)
+        return;
+    line.put('.');
+    for (uint32_t power = powers[decimals] / 10; power; power /= 10)
+        line.put('0' + fixed / power % 10);
+}
+
+//the signals of the frame that differ from the old frame (all of them without one), nothing if none did
+void printSignals(const data_frame &frame, const data_frame *old_frame)
+{
+    uint8_t changed = signals.changed(frame, old_frame);
+    if (!changed)
+        return;
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_signals;
+        record[1] = frame.channel;
+        record[2] = frame.id;
+        binary_protocol::putU32(record + 3, frame.time);
+        uint8_t length = 8;
+        for (uint8_t place = 0; place < signals.signalsOf(frame.id); ++place)
         {
-            Serial.flush();
-            pos = 0;
+            if (!(changed & (1 << place)))
+                continue;
+            uint8_t index = signals.signalAt(frame.id, place);
+            record[length] = index;
+            binary_protocol::putFloat(record + length + 1, signals.value(index, frame));
+            length += 5;
         }
+        record[7] = (length - 8) / 5;
+        sendRecord(record, length);
+        return;
     }
-    return false;
+    setColor(line, old_frame ? C_BLU : C_GRN);
+    if (!if_newlined)
+        line.put('\n');
+    putTime(frame.time);
+    putChannel(frame.channel);
+    line.putHex(frame.id);
+    line.put(" :");
+    for (uint8_t place = 0; place < signals.signalsOf(frame.id); ++place)
+    {
+        if (!(changed & (1 << place)))
+            continue;
+        uint8_t index = signals.signalAt(frame.id, place);
+        line.put(' ');
+        const char *name = signals.def(index).name;
+        while (*name)
+            line.put(*name++);
+        line.put('=');
+        putFixed(signals.value(index, frame), signals.decimals(index));
+    }
+    line.put("\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
 }
 
-void parseSerial()
+//reports what the output queue had to give up since the last time
+void printDrops()
 {
-    char buffer[BUFFER_SIZE];
-    if (getCommand(buffer))
+    uint32_t dropped = reports.dropped - reported_dropped;
+    uint32_t coalesced = reports.coalesced - reported_coalesced;
+    reported_dropped = reports.dropped;
+    reported_coalesced = reports.coalesced;
+    if (config.output == output_binary)
     {
-        char *command_word;
-        command_word = strtok(buffer, " ");
-        if (command_word != NULL)
-        {
-            uint8_t len = strlen(command_word);
-            //first word - options:
-            if (len == 4 && !memcmp(command_word, "baud", 4))
-            {
-                command_word = strtok(NULL, " ");
-                if (command_word != NULL)
-                {
-                    long baud = atoi(command_word);
-                    if (baud >= 1000 && baud <= 20000)
-                    {
-                        setBaudrate(baud);
-                        setColor(C_YLW);
-                        Serial.print("Baudrate changed to ");
-                        Serial.println(baud);
-                        setColor(C_RST);
-                    }
-                    else
-                    {
-                        setColor(C_RED);
-                        Serial.println("Specify baudrate between 1000 and 20000.");
-                        setColor(C_RST);
-                    }
-                }
-                else
-                {
-                    setColor(C_RED);
-                    Serial.println("Specify baudrate between 1000 and 20000.");
-                    setColor(C_RST);
-                }
-            }
-            else if (len == 5 && !memcmp(command_word, "start", 5))
-            {
-                startSniffing();
-                setColor(C_YLW);
-                Serial.println("Starting sniffing the LIN bus...");
-                setColor(C_RST);
-            }
-            else if (len == 4 && !memcmp(command_word, "stop", 4))
-            {
-                stopSniffing();
-                setColor(C_YLW);
-                Serial.println("Stopped sniffing the LIN bus.");
-                setColor(C_RST);
-            }
-            else if (len == 4 && !memcmp(command_word, "show", 4))
-            {
-                command_word = strtok(NULL, " ");
-                if (command_word != NULL)
-                {
-                    //OPTIONS: never, change, always
-                    frame_option_t option = option_undefined;
-                    len = strlen(command_word);
-                    if (len == 5 && !memcmp(command_word, "never", 5))
-                        option = option_never;
-                    else if (len == 6 && !memcmp(command_word, "change", 6))
-                        option = option_change;
-                    else if (len == 6 && !memcmp(command_word, "always", 6))
-                        option = option_always;
-                    if (option != option_undefined)
-                    {
-                        command_word = strtok(NULL, " ");
-                        if (command_word != NULL)
-                        {
-                            len = strlen(command_word);
-                            if (len == 3 && !memcmp(command_word, "all", 3))
-                            {
-                                for (uint8_t i = 0; i < LIN_MEM_SIZE; ++i)
-                                    setFrameOption(i, option);
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_drops;
+        binary_protocol::putU32(record + 1, dropped);
+        binary_protocol::putU32(record + 5, coalesced);
+        sendRecord(record, 9);
+        return;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, C_YLW);
+    line.put("Output overflow - dropped: ");
+    line.putDec(dropped);
+    line.put(", coalesced: ");
+    line.putDec(coalesced);
+    line.put("\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+}
 
-                                setColor(C_YLW);
-                                switch (option)
-                                {
-                                case option_never:
+//a number with one decimal, given in tenths
+void putTenths(uint32_t tenths)
+{
+    line.putDec(tenths / 10);
+    line.put('.');
+    line.put('0' + tenths % 10);
+}
 
-                                    Serial.println("All frames are set to never show.");
-                                    break;
-                                case option_change:
-                                    Serial.println("All frames are set to show on change.");
-                                    break;
-                                case option_always:
-                                    Serial.println("All frames are set to always show.");
-                                default:
-                                    break;
-                                }
-                                setColor(C_RST);
-                            }
-                            else //ignore some frames
-                                while (command_word != NULL)
-                                {
-                                    len = strlen(command_word);
-                                    bool alphanumeric = true;
-                                    for (uint8_t i = 0; i < len; ++i)
-                                        alphanumeric &= isHexadecimalDigit(command_word[i]);
-                                    if (alphanumeric)
-                                    {
-                                        long id = strtol(command_word, NULL, 16);
-                                        if (((id >= 1 && id <= 0x3F) || (id == 0 && command_word[0] == '0')))
-                                        {
-                                            setColor(C_YLW);
-                                            setFrameOption(id, option);
-                                            Serial.print("Frame ID ");
-                                            Serial.print(HexToString(id, HEX));
-                                            switch (option)
-                                            {
-                                            case option_never:
-                                                Serial.println(" is set to never show.");
-                                                break;
-                                            case option_change:
-                                                Serial.println(" is set to show on change.");
-                                                break;
-                                            case option_always:
-                                                Serial.println(" is set to always show.");
-                                            default:
+//periodic statistics: first the values of the sniffer, then one record for every bus
+void printStatsRecord(uint8_t index)
+{
+    const stats_t &s = stats_result;
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        if (index == 0)
+        {
+            record[0] = record_stats;
+            binary_protocol::putU32(record + 1, s.period_ms);
+            binary_protocol::putU32(record + 5, s.max_loop_ns);
+            binary_protocol::putU16(record + 9, s.callback_permille);
+            binary_protocol::putU32(record + 11, s.max_callback_ns);
+            binary_protocol::putU16(record + 15, s.high_water);
+            sendRecord(record, 17);
+            return;
+        }
+        const bus_stats_t &bus = s.buses[index - 1];
+        record[0] = record_bus_stats;
+        record[1] = bus.channel;
+        binary_protocol::putU32(record + 2, bus.frames);
+        binary_protocol::putU16(record + 6, bus.load_permille);
+        binary_protocol::putU32(record + 8, bus.glitches);
+        binary_protocol::putU32(record + 12, bus.dropped_frames);
+        sendRecord(record, 16);
+        return;
+    }
+    //key=value, so the lines can be picked out of the text output
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, C_YLW);
+    line.put("ST: ");
+    if (index == 0)
+    {
+        line.put("period_ms=");
+        line.putDec(s.period_ms);
+        line.put(" loop_max_us=");
+        putTenths(s.max_loop_ns / 100);
+        line.put(" callbacks_pct=");
+        putTenths(s.callback_permille);
+        line.put(" callback_max_us=");
+        putTenths(s.max_callback_ns / 100);
+        line.put(" queue_high_water=");
+        line.putDec(s.high_water);
+    }
+    else
+    {
+        const bus_stats_t &bus = s.buses[index - 1];
+        line.put("channel=");
+        line.putDec(bus.channel);
+        line.put(" frames=");
+        line.putDec(bus.frames);
+        line.put(" fps=");
+        putTenths(bus.frames_per_second10);
+        line.put(" load_pct=");
+        putTenths(bus.load_permille);
+        line.put(" glitches=");
+        line.putDec(bus.glitches);
+        line.put(" dropped=");
+        line.putDec(bus.dropped_frames);
+    }
+    line.put("\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+}
+
+//one step of a trigger dump, false if there is nothing to send
+bool printDump()
+{
+    captured_frame captured;
+    bool fired = false;
+    dump_step_t step = triggers.next(captured, fired);
+    if (step == dump_idle)
+        return false;
+    if (step == dump_frame)
+    {
+        data_frame frame;
+        frame.channel = captured.channel;
+        frame.id = captured.id;
+        frame.data_count = captured.data_count;
+        memcpy(frame.data, captured.data, sizeof(frame.data));
+        frame.chk = captured.chk;
+        frame.time = captured.time;
+        frame.status = (frame_status_t)captured.status;
+        if (config.output == output_binary)
+        {
+            uint8_t flags = frame.status == frame_parity_error ? BIN_FLAG_PARITY_ERROR : frame.status == frame_checksum_error ? BIN_FLAG_CHECKSUM_ERROR
+                                                                                                                              : 0;
+            sendFrameRecord(frame, fired ? flags | BIN_FLAG_TRIGGER : flags);
+            return true;
+        }
+        if (!if_newlined)
+            line.put('\n');
+        if (fired || frame.status != frame_valid)
+            setColor(line, C_RED);
+        putTime(frame.time);
+        putChannel(frame.channel);
+        line.putHex(frame.id);
+        line.put(" | ");
+        for (int i = 0; i < frame.data_count; ++i)
+        {
+            line.putHex(frame.data[i]);
+            line.put(' ');
+        }
+        line.put('(');
+        line.putHex(frame.chk);
+        line.put(')');
+        if (frame.status == frame_parity_error)
+            line.put(" parity error");
+        else if (frame.status == frame_checksum_error)
+            line.put(" checksum error");
+        if (fired)
+            line.put(" <- trigger");
+        line.put("\r\n");
+        setColor(line, C_RST);
+        if_newlined = true;
+        return true;
+    }
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_trigger;
+        record[1] = step == dump_marker ? BIN_TRIGGER_FIRED : BIN_TRIGGER_END;
+        record[2] = triggers.fired_trigger;
+        record[3] = triggers.fired_channel;
+        binary_protocol::putU32(record + 4, triggers.fired_time);
+        binary_protocol::putU16(record + 8, step == dump_finished ? triggers.lost : 0);
+        sendRecord(record, 10);
+        return true;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, C_YLW);
+    if (step == dump_marker)
+    {
+        putTime(triggers.fired_time);
+        line.put("TR: trigger ");
+        line.putDec(triggers.fired_trigger);
+        line.put(" fired\r\n");
+    }
+    else
+    {
+        line.put("TR: end of capture");
+        if (triggers.lost)
+        {
+            line.put(", ");
+            line.putDec(triggers.lost);
+            line.put(" frames lost");
+        }
+        line.put("\r\n");
+    }
+    setColor(line, C_RST);
+    if_newlined = true;
+    return true;
+}
+
+//an anomaly of the schedule, false if there is nothing to send
+bool printScheduleEvent()
+{
+    schedule_event event;
+    if (!schedule_events.pop(event))
+        return false;
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_schedule;
+        record[1] = event.kind;
+        record[2] = event.channel;
+        record[3] = event.table;
+        record[4] = event.slot;
+        record[5] = event.id;
+        record[6] = event.count;
+        binary_protocol::putU32(record + 7, event.time);
+        binary_protocol::putU32(record + 11, event.measured);
+        binary_protocol::putU32(record + 15, event.expected);
+        sendRecord(record, 19);
+        return true;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, event.kind == schedule_learned || event.kind == schedule_switched ? C_YLW : C_RED);
+    putTime(event.time);
+    putChannel(event.channel);
+    line.put("SC: ");
+    switch (event.kind)
+    {
+    case schedule_learned:
+        line.put("table ");
+        line.putDec(event.table);
+        line.put(" learned, ");
+        line.putDec(event.count);
+        line.put(" slots, cycle ");
+        line.putDec(event.expected);
+        line.put(" us");
+        break;
+    case schedule_switched:
+        line.put("switched to table ");
+        line.putDec(event.table);
+        break;
+    case schedule_missing:
+        line.putDec(event.count);
+        line.put(" slots missing from slot ");
+        line.putDec(event.slot);
+        line.put(" (id ");
+        line.putHex(event.id);
+        line.put(')');
+        break;
+    case schedule_extra:
+        line.put("extra frame ");
+        line.putHex(event.id);
+        break;
+    case schedule_jitter:
+        line.put("slot ");
+        line.putDec(event.slot);
+        line.put(" (id ");
+        line.putHex(event.id);
+        line.put(") ");
+        line.putDec(event.measured);
+        line.put(" us after the slot before, expected ");
+        line.putDec(event.expected);
+        line.put(" us");
+        break;
+    default:
+        //either the frames stopped or they no longer fit
+        if (event.measured)
+        {
+            line.put("no frames for ");
+            line.putDec(event.measured);
+            line.put(" us, ");
+        }
+        line.put("schedule lost");
+        break;
+    }
+    line.put("\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+    return true;
+}
+
+//a reassembled diagnostic message, false if there is nothing to send
+bool printDiagnostic()
+{
+    tp_message message;
+    if (!diagnostic_messages.pop(message))
+        return false;
+    uint8_t count = message.received < TP_MESSAGE_DATA ? message.received : TP_MESSAGE_DATA;
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_diagnostic;
+        record[1] = message.status;
+        record[2] = message.channel;
+        record[3] = message.id;
+        record[4] = message.nad;
+        binary_protocol::putU16(record + 5, message.length);
+        binary_protocol::putU16(record + 7, message.received);
+        binary_protocol::putU32(record + 9, message.time);
+        binary_protocol::putU32(record + 13, message.duration);
+        binary_protocol::putU32(record + 17, message.latency);
+        record[21] = count;
+        memcpy(record + 22, message.data, count);
+        sendRecord(record, 22 + count);
+        return true;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, message.status == tp_complete || message.status == tp_sleep ? C_BLU : C_RED);
+    putTime(message.time);
+    putChannel(message.channel);
+    line.put(message.id == LIN_MASTER_REQUEST ? "DG req " : "DG rsp ");
+    line.putHex(message.nad);
+    if (message.status == tp_sleep)
+        line.put(" go to sleep");
+    else
+    {
+        line.put(" |");
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            line.put(' ');
+            line.putHex(message.data[i]);
+        }
+        line.put(" | ");
+        if (message.status != tp_complete && message.status != tp_unexpected)
+        {
+            line.putDec(message.received);
+            line.put(" of ");
+        }
+        if (message.status != tp_unexpected)
+        {
+            line.putDec(message.length);
+            line.put(" bytes");
+        }
+        if (count < message.received)
+        {
+            line.put(" (first ");
+            line.putDec(count);
+            line.put(" shown)");
+        }
+        switch (message.status)
+        {
+        case tp_sequence:
+            line.put(", sequence error");
+            break;
+        case tp_interrupted:
+            line.put(", interrupted");
+            break;
+        case tp_timeout:
+            line.put(", timeout");
+            break;
+        case tp_unexpected:
+            line.put("unexpected frame");
+            break;
+        default:
+            break;
+        }
+        if (message.duration)
+        {
+            line.put(", ");
+            line.putDec(message.duration);
+            line.put(" us");
+        }
+        if (message.latency)
+        {
+            line.put(", ");
+            line.putDec(message.latency);
+            line.put(" us after the request");
+        }
+    }
+    line.put("\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+    return true;
+}
+
+//the raw bytes of a malformed frame, false if there is nothing to send
+bool printMalformed()
+{
+    malformed_frame frame;
+    if (!malformed_frames.pop(frame))
+        return false;
+    uint8_t count = frame.byte_count < LIN_MAX_FRAME_BYTES ? frame.byte_count : LIN_MAX_FRAME_BYTES;
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_malformed;
+        record[1] = frame.channel;
+        record[2] = frame.kinds;
+        record[3] = frame.byte_count;
+        binary_protocol::putU32(record + 4, frame.time);
+        binary_protocol::putU32(record + 8, frame.break_length);
+        memcpy(record + 12, frame.bytes, count);
+        sendRecord(record, 12 + count);
+        return true;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, C_RED);
+    putTime(frame.time);
+    putChannel(frame.channel);
+    line.put("MF: ");
+    bool first = true;
+    for (uint8_t kind = 0; kind < MALFORMED_KINDS; ++kind)
+    {
+        if (!(frame.kinds & (1 << kind)))
+            continue;
+        if (!first)
+            line.put(", ");
+        first = false;
+        const char *name = MALFORMED_NAMES[kind];
+        while (*name)
+            line.put(*name++);
+    }
+    line.put(" |");
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        line.put(' ');
+        line.putHex(frame.bytes[i]);
+    }
+    if (count < frame.byte_count)
+    {
+        line.put(" +");
+        line.putDec(frame.byte_count - count);
+    }
+    line.put(" | break ");
+    line.putDec(frame.break_length);
+    line.put(" us\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+    return true;
+}
+
+//the next payload of the history being read back, then its end. False if none is read
+bool printHistory()
+{
+    if (!history_dump.active)
+        return false;
+    uint8_t id;
+    history_entry entry;
+    bool payload = history_dump.next(history, id, entry);
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_history;
+        record[1] = payload ? entry.channel : 0;
+        record[2] = payload ? id : 0;
+        record[3] = payload ? entry.data_count : 0;
+        binary_protocol::putU32(record + 4, payload ? entry.time : 0);
+        binary_protocol::putU32(record + 8, payload ? entry.count : history_dump.sent);
+        if (payload)
+            memcpy(record + 12, entry.data, entry.data_count);
+        sendRecord(record, 12 + record[3]);
+        return true;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    if (!payload)
+    {
+        setColor(line, C_YLW);
+        line.put("HI: end of history, ");
+        line.putDec(history_dump.sent);
+        line.put(" payloads\r\n");
+        setColor(line, C_RST);
+        if_newlined = true;
+        return true;
+    }
+    putTime(entry.time);
+    putChannel(entry.channel);
+    line.putHex(id);
+    line.put(" | ");
+    for (int i = 0; i < entry.data_count; ++i)
+    {
+        line.putHex(entry.data[i]);
+        line.put(' ');
+    }
+    line.put("| x");
+    line.putDec(entry.count);
+    line.put("\r\n");
+    if_newlined = true;
+    return true;
+}
+
+//the count of frames the limit of the id held back
+void printSuppressed(const report_t &report)
+{
+    if (config.output == output_binary)
+    {
+        uint8_t record[BIN_MAX_RECORD];
+        record[0] = record_suppressed;
+        record[1] = report.frame.channel;
+        record[2] = report.frame.id;
+        binary_protocol::putU32(record + 3, report.suppressed);
+        binary_protocol::putU32(record + 7, report.time);
+        sendRecord(record, 11);
+        return;
+    }
+    if (!if_newlined)
+        line.put('\n');
+    setColor(line, C_YLW);
+    putTime(report.time);
+    putChannel(report.frame.channel);
+    line.putHex(report.frame.id);
+    line.put(" | x");
+    line.putDec(report.suppressed);
+    line.put(" suppressed\r\n");
+    setColor(line, C_RST);
+    if_newlined = true;
+}
+
+void printReport(const report_t &report)
+{
+    switch (report.kind)
+    {
+    case report_new_loop:
+        printNewLoop(report.frame.channel, report.loop_frames, report.time);
+        break;
+    case report_new:
+        if (isDecoded(report.frame))
+            printSignals(report.frame, nullptr);
+        else
+            printNewFrame(report.frame);
+        break;
+    case report_changed:
+        if (isDecoded(report.frame))
+            printSignals(report.frame, &report.old_frame);
+        else
+            printChangedFrame(report.frame, &report.old_frame);
+        break;
+    case report_unchanged:
+        printUnchangedFrame(report.frame);
+        break;
+    case report_error:
+        printErrorFrame(report.frame);
+        break;
+    case report_suppressed:
+        printSuppressed(report);
+        break;
+    }
+}
+
+//the end of a save, a command reply (text in both modes). False if there is nothing to send
+bool printSettingsResult()
+{
+    if (settings_result == settings_idle)
+        return false;
+    if (config.output == output_text && !if_newlined)
+        line.put('\n');
+    if (settings_result == settings_saved)
+    {
+        setColor(line, C_YLW);
+        line.put("Settings saved.\r\n");
+    }
+    else
+    {
+        setColor(line, C_RED);
+        line.put("Saving the settings failed.\r\n");
+    }
+    setColor(line, C_RST);
+    if (config.output == output_binary)
+        line.put((char)BIN_DELIMITER);
+    else
+        if_newlined = true;
+    settings_result = settings_idle;
+    return true;
+}
+
+//sends the queued reports only as fast as the host serial port takes them - never blocks the reception
+void drainOutput()
+{
+    while (true)
+    {
+        if (line_sent == line.length)
+        {
+            //the reply of the waiting command goes next
+            if (command_waiting)
+                return;
+            line.clear();
+            line_sent = 0;
+            report_t report;
+            if (config.view == view_table)
+            {
+                if (!printSettingsResult() && !table.draw(line, buses, hal::timestamp()))
+                    return;
+            }
+            else if (reports.dropped != reported_dropped || reports.coalesced != reported_coalesced)
+                printDrops(); //in front of the reports that follow the gap
+            else if (stats_pending)
+            {
+                printStatsRecord(1 + LIN_CHANNELS - stats_pending);
+                --stats_pending;
+            }
+            else if (!printDump() && !printHistory() && !printScheduleEvent() && !printDiagnostic() && !printMalformed() && !printSettingsResult())
+            {
+                if (!reports.pop(report))
+                    return;
+                printReport(report);
+            }
+            continue;
+        }
+        int space = HostSerial.availableForWrite();
+        if (space <= 0)
+            return;
+        uint16_t length = line.length - line_sent;
+        if (space < length)
+            length = space;
+        HostSerial.write((const uint8_t *)line.text + line_sent, length);
+        line_sent += length;
+    }
+}
+
+//while triggers are set nothing is reported live
+void queueScheduleEvent(uint8_t channel, schedule_event &event)
+{
+    if (triggers.active() || config.view == view_table)
+        return;
+    event.channel = channel;
+    schedule_events.push(event);
+}
+
+//feeds the schedule monitor of the bus with a frame whose id can be trusted
+void watchSchedule(const data_frame &frame)
+{
+    if (config.schedule == schedule_off)
+        return;
+    schedule_event event;
+    if (schedules[frame.channel - 1].frame(frame.id, frame.time, event))
+        queueScheduleEvent(frame.channel, event);
+}
+
+//the frames of the id its limit held back, reported in front of the next report of the id (or alone, see pollMonitors)
+void queueSuppressed(uint8_t channel, uint8_t id)
+{
+    report_t report;
+    report.suppressed = limiter.take(channel, id, report.time);
+    if (!report.suppressed || triggers.active() || config.view == view_table)
+        return;
+    report.kind = report_suppressed;
+    report.frame.channel = channel;
+    report.frame.id = id;
+    reports.push(report, config.overflow);
+}
+
+//whether the limit of the id lets the frame be reported
+bool passLimit(const data_frame &frame)
+{
+    const id_limit &limit = config.limits[frame.id];
+    if (limit.kind == limit_off)
+        return true;
+    if (!limiter.pass(limit, frame))
+        return false;
+    queueSuppressed(frame.channel, frame.id);
+    return true;
+}
+
+//a message finished by the transport layer of a bus. Like the frames, messages are not reported live while triggers
+//are set, nor in schedule 'only' mode; 'frame 3c never' (or 3d) hides them
+void MarkMessage(tp_message &message)
+{
+    if (triggers.active() || config.view == view_table || config.schedule == schedule_only || config.frame_verbosity[message.id] == option_never)
+        return;
+    diagnostic_messages.push(message);
+}
+
+//callbacks of the LIN sniffer - the frames are only queued here
+//a frame that could not be received as it should, it is counted by the bus. Frames with a PID are reported as well
+void MarkMalformedFrame(malformed_frame &frame)
+{
+    //while triggers are set nothing is reported live
+    if (!config.malformed_dump || triggers.active() || config.view == view_table)
+        return;
+    malformed_frames.push(frame);
+}
+
+void MarkNewLoop(uint8_t channel, uint8_t frame)
+{
+    //a learned schedule knows its cycles better
+    if (triggers.active() || config.view == view_table || config.schedule == schedule_only)
+        return;
+    report_t report;
+    report.kind = report_new_loop;
+    report.frame.channel = channel;
+    report.loop_frames = frame;
+    report.time = buses[channel - 1]->frame_time; //the loop starts with the break of the frame being processed
+    reports.push(report, config.overflow);
+}
+
+void MarkNewFrame(data_frame &frame)
+{
+    watchSchedule(frame);
+    history.record(frame);
+    //while triggers are set nothing is reported live
+    if (triggers.active())
+    {
+        triggers.capture(frame);
+        return;
+    }
+    if (!isReported(report_new, frame, nullptr) || !passLimit(frame))
+        return;
+    report_t report;
+    report.kind = report_new;
+    report.frame = frame;
+    reports.push(report, config.overflow);
+}
+
+void MarkChangedFrame(data_frame &frame, data_frame *old_frame)
+{
+    watchSchedule(frame);
+    history.record(frame);
+    //while triggers are set nothing is reported live
+    if (triggers.active())
+    {
+        triggers.capture(frame);
+        return;
+    }
+    if (!isReported(report_changed, frame, old_frame))
+        return;
+    //only the data outside of the signals may have changed
+    if (isDecoded(frame) && !signals.changed(frame, old_frame))
+        return;
+    if (!passLimit(frame))
+        return;
+    report_t report;
+    report.kind = report_changed;
+    report.frame = frame;
+    report.old_frame = *old_frame;
+    reports.push(report, config.overflow);
+}
+
+void MarkUnchangedFrame(data_frame &frame)
+{
+    watchSchedule(frame);
+    history.record(frame);
+    //while triggers are set nothing is reported live
+    if (triggers.active())
+    {
+        triggers.capture(frame);
+        return;
+    }
+    if (!isReported(report_unchanged, frame, &frame) || isDecoded(frame) || !passLimit(frame))
+        return;
+    report_t report;
+    report.kind = report_unchanged;
+    report.frame = frame;
+    reports.push(report, config.overflow);
+}
+
+void MarkErrorFrame(data_frame &frame)
+{
+    //the id of a frame with a wrong checksum is still right, it took its slot
+    if (frame.status == frame_checksum_error)
+    {
+        watchSchedule(frame);
+        if (config.transport && (frame.id == LIN_MASTER_REQUEST || frame.id == LIN_SLAVE_RESPONSE))
+            transports[frame.channel - 1].damaged(frame);
+    }
+    //while triggers are set nothing is reported live
+    if (triggers.active())
+    {
+        triggers.capture(frame);
+        return;
+    }
+    if (!isReported(report_error, frame, nullptr))
+        return;
+    report_t report;
+    report.kind = report_error;
+    report.frame = frame;
+    reports.push(report, config.overflow);
+}
+
+//diagnostic frames (with a valid checksum) while the transport layer is on, kept out of FRAME_MEMORY
+void MarkDiagnosticFrame(data_frame &frame)
+{
+    watchSchedule(frame);
+    //while triggers are set nothing is reported live
+    if (triggers.active())
+    {
+        triggers.capture(frame);
+        return;
+    }
+    transports[frame.channel - 1].frame(frame);
+}
+
+//error counters and checksum model of every id that had any of them, on every bus
+void printErrors()
+{
+    bool any = false;
+    for (lin_bus *bus : buses)
+        for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+        {
+            uint32_t parity = bus->parity_errors[id];
+            uint32_t checksum = bus->checksum_errors[id];
+            checksum_model_t model = bus->checksum_model[id];
+            if (!parity && !checksum && !(bus->saved_frames & LIN_ID_BIT(id)))
+                continue;
+            any = true;
+            HostSerial.print((unsigned long)bus->channel);
+            HostSerial.print(":");
+            printHex(id);
+            HostSerial.print(" | parity errors: ");
+            HostSerial.print(parity);
+            HostSerial.print(", checksum errors: ");
+            HostSerial.print(checksum);
+            HostSerial.print(", checksum model: ");
+            HostSerial.println(model == model_classic ? "classic" : model == model_enhanced ? "enhanced" : "unknown");
+        }
+    if (!any)
+        HostSerial.println("No frames received.");
+}
+
+//malformed frames of every kind, on every bus
+void printMalformedCounts()
+{
+    for (lin_bus *bus : buses)
+    {
+        HostSerial.print((unsigned long)bus->channel);
+        HostSerial.print(":");
+        for (uint8_t kind = 0; kind < MALFORMED_KINDS; ++kind)
+        {
+            HostSerial.print(kind ? ", " : " ");
+            HostSerial.print(MALFORMED_NAMES[kind]);
+            HostSerial.print(' ');
+            HostSerial.print(bus->malformed[kind]);
+        }
+        HostSerial.print(", bytes outside of frames ");
+        HostSerial.println(bus->stray_bytes);
+    }
+    HostSerial.print("Dumps lost (output full): ");
+    HostSerial.println((unsigned long)malformed_frames.overflows);
+}
+
+//min/avg/max of a measurement, in us
+void printTimingMetric(const char *name, const timing_metric &m)
+{
+    HostSerial.print(name);
+    if (!m.count)
+    {
+        HostSerial.print(" -");
+        return;
+    }
+    HostSerial.print(' ');
+    HostSerial.print((unsigned long)m.min);
+    HostSerial.print('/');
+    HostSerial.print((unsigned long)(m.sum / m.count));
+    HostSerial.print('/');
+    HostSerial.print((unsigned long)m.max);
+}
+
+//timing of every id (or one id, with the histograms) on every bus (or one)
+void printTiming(uint8_t only_id, uint8_t only_channel)
+{
+    static const char *const names[TIMING_METRICS] = {"break", "header", "delay", "response", "gap"};
+    bool any = false;
+    for (lin_bus *bus : buses)
+    {
+        if (only_channel && bus->channel != only_channel)
+            continue;
+        for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+        {
+            const id_timing &t = bus->timing[id];
+            if ((only_id != LIN_MEM_SIZE && id != only_id) || !t.metrics[timing_header].count)
+                continue;
+            any = true;
+            HostSerial.print((unsigned long)bus->channel);
+            HostSerial.print(":");
+            printHex(id);
+            HostSerial.print(" | frames ");
+            HostSerial.print(t.metrics[timing_header].count);
+            for (uint8_t metric = 0; metric < TIMING_METRICS; ++metric)
+            {
+                HostSerial.print(", ");
+                printTimingMetric(names[metric], t.metrics[metric]);
+            }
+            HostSerial.print(" us, late headers ");
+            HostSerial.print(t.late_headers);
+            HostSerial.print(", late responses ");
+            HostSerial.print(t.late_responses);
+            HostSerial.print(", no response ");
+            HostSerial.println(t.no_response);
+            if (only_id == LIN_MEM_SIZE)
+                continue;
+            //the bins are labeled with their lower bound
+            for (uint8_t metric = 0; metric < TIMING_METRICS; ++metric)
+            {
+                const timing_metric &m = t.metrics[metric];
+                const uint16_t *edges = timing_metric::isRatio(metric) ? TIMING_RATIO_EDGES : TIMING_SPACE_EDGES;
+                HostSerial.print("  ");
+                HostSerial.print(names[metric]);
+                HostSerial.print(timing_metric::isRatio(metric) ? " (% of nominal):" : " (bits):");
+                for (uint8_t bin = 0; bin < TIMING_BINS; ++bin)
+                {
+                    HostSerial.print(' ');
+                    uint16_t lower = bin ? edges[bin - 1] : 0;
+                    HostSerial.print((unsigned long)(timing_metric::isRatio(metric) ? lower : lower / 100));
+                    HostSerial.print(bin == TIMING_BINS - 1 ? "+=" : "=");
+                    HostSerial.print((unsigned long)m.bins[bin]);
+                }
+                if (m.binsFull())
+                    HostSerial.print(" (a bin is full and stopped counting, see 'timing clear')");
+                HostSerial.println();
+            }
+        }
+    }
+    if (!any)
+        HostSerial.println("No frames measured.");
+}
+
+//statistics since the start or 'stats clear'
+//cycles of the CPU in us, one decimal
+void printCycles(uint32_t cycles)
+{
+    HostSerial.print((double)cycles / hal::cyclesPerMicrosecond(), 1);
+    HostSerial.print(" us");
+}
+
+void printTask(const task &t)
+{
+    HostSerial.print(t.name);
+    HostSerial.print(" | calls: ");
+    HostSerial.print((unsigned long)t.calls);
+    HostSerial.print(", worst case: ");
+    printCycles(t.max_cycles);
+    HostSerial.println();
+}
+
+//the worst case execution time of every task of loop() and the longest the reception waited for one
+void printTasks()
+{
+    printTask(scheduler.urgentTask());
+    for (uint8_t i = 0; i < scheduler.size(); ++i)
+        printTask(scheduler.at(i));
+    HostSerial.print("Longest time without reception: ");
+    printCycles(scheduler.maxGapCycles());
+    HostSerial.println();
+}
+
+void printStats()
+{
+    stats_t s;
+    stats.collect();
+    stats.report(stats.total, s);
+    HostSerial.print("Statistics of the last ");
+    HostSerial.print(stats.total.elapsed / 1e6, 1);
+    HostSerial.println(" s:");
+    HostSerial.print("loop() max: ");
+    HostSerial.print(s.max_loop_ns / 1000.0, 1);
+    HostSerial.print(" us, callbacks: ");
+    HostSerial.print(s.callback_permille / 10.0, 1);
+    HostSerial.print("% of the time (max ");
+    HostSerial.print(s.max_callback_ns / 1000.0, 1);
+    HostSerial.print(" us), output queue high water: ");
+    HostSerial.print((unsigned long)s.high_water);
+    HostSerial.print(" of ");
+    HostSerial.println((unsigned long)OUTPUT_QUEUE_SIZE);
+    for (uint8_t i = 0; i < LIN_CHANNELS; ++i)
+    {
+        const bus_stats_t &bus = s.buses[i];
+        HostSerial.print((unsigned long)bus.channel);
+        HostSerial.print(" | frames: ");
+        HostSerial.print(bus.frames);
+        HostSerial.print(" (");
+        HostSerial.print(bus.frames_per_second10 / 10.0, 1);
+        HostSerial.print("/s), bus load: ");
+        HostSerial.print(bus.load_permille / 10.0, 1);
+        HostSerial.print("%, glitches: ");
+        HostSerial.print(bus.glitches);
+        HostSerial.print(", dropped: ");
+        HostSerial.println(bus.dropped_frames);
+        for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+        {
+            if (!buses[i]->frame_count[id])
+                continue;
+            HostSerial.print((unsigned long)bus.channel);
+            HostSerial.print(":");
+            printHex(id);
+            HostSerial.print(" | ");
+            HostSerial.print(buses[i]->frame_count[id]);
+            HostSerial.println(" frames");
+        }
+    }
+}
+
+//a hexadecimal number up to max, false if the word is not one
+bool parseHex(const char *word, long max, uint8_t &value)
+{
+    if (word == NULL || !*word)
+        return false;
+    for (const char *c = word; *c; ++c)
+        if (!isHexadecimalDigit(*c))
+            return false;
+    long number = strtol(word, NULL, 16);
+    if (number > max)
+        return false;
+    value = number;
+    return true;
+}
+
+void printTriggers()
+{
+    bool any = false;
+    for (uint8_t i = 0; i < TRIGGER_COUNT; ++i)
+    {
+        const trigger_t &t = triggers.trigger(i);
+        if (t.kind == trigger_none)
+            continue;
+        any = true;
+        HostSerial.print((unsigned long)i + 1);
+        HostSerial.print(" | ");
+        switch (t.kind)
+        {
+        case trigger_match:
+            HostSerial.print("match ");
+            printHex(t.id);
+            if (t.byte != TRIGGER_NO_BYTE)
+            {
+                HostSerial.print(", byte ");
+                HostSerial.print((unsigned long)t.byte);
+                HostSerial.print(" & ");
+                printHex(t.mask);
+                HostSerial.print(" == ");
+                printHex(t.value);
+            }
+            break;
+        case trigger_error:
+            HostSerial.print("error ");
+            if (t.id == TRIGGER_ANY_ID)
+                HostSerial.print("any id");
+            else
+                printHex(t.id);
+            break;
+        case trigger_missing:
+            HostSerial.print("missing ");
+            printHex(t.id);
+            HostSerial.print(" for ");
+            HostSerial.print((unsigned long)t.timeout / 1000);
+            HostSerial.print(" ms");
+            break;
+        default:
+            break;
+        }
+        if (t.channel)
+        {
+            HostSerial.print(", channel ");
+            HostSerial.print((unsigned long)t.channel);
+        }
+        HostSerial.println();
+    }
+    if (!any)
+    {
+        HostSerial.println("No triggers set, frames are reported live.");
+        return;
+    }
+    HostSerial.print("Frames dumped before: ");
+    HostSerial.print((unsigned long)triggers.before);
+    HostSerial.print(", after: ");
+    HostSerial.print((unsigned long)triggers.after);
+    HostSerial.print(", triggers ignored during a dump: ");
+    HostSerial.println(triggers.ignored);
+}
+
+//trigger match|error|missing ... [ch <channel>]
+void parseTrigger(char *command_word)
+{
+    trigger_t trigger = {};
+    trigger.byte = TRIGGER_NO_BYTE;
+    uint8_t len = strlen(command_word);
+    bool valid = true;
+    if (len == 5 && !memcmp(command_word, "match", 5))
+    {
+        //id [byte mask value]
+        trigger.kind = trigger_match;
+        valid = parseHex(strtok(NULL, " "), 0x3F, trigger.id);
+        command_word = strtok(NULL, " ");
+        if (valid && command_word != NULL && strcmp(command_word, "ch"))
+        {
+            valid = parseHex(command_word, 7, trigger.byte) && parseHex(strtok(NULL, " "), 0xFF, trigger.mask) &&
+                    parseHex(strtok(NULL, " "), 0xFF, trigger.value);
+            command_word = strtok(NULL, " ");
+        }
+    }
+    else if (len == 5 && !memcmp(command_word, "error", 5))
+    {
+        //[id]
+        trigger.kind = trigger_error;
+        trigger.id = TRIGGER_ANY_ID;
+        command_word = strtok(NULL, " ");
+        if (command_word != NULL && strcmp(command_word, "ch"))
+        {
+            valid = parseHex(command_word, 0x3F, trigger.id);
+            command_word = strtok(NULL, " ");
+        }
+    }
+    else if (len == 7 && !memcmp(command_word, "missing", 7))
+    {
+        //id milliseconds
+        trigger.kind = trigger_missing;
+        valid = parseHex(strtok(NULL, " "), 0x3F, trigger.id);
+        command_word = strtok(NULL, " ");
+        long ms = command_word != NULL ? atoi(command_word) : 0;
+        valid &= ms >= 1 && ms <= 60000;
+        trigger.timeout = ms * 1000;
+        command_word = strtok(NULL, " ");
+    }
+    else
+        valid = false;
+    //every trigger can be limited to one bus
+    if (valid && command_word != NULL)
+    {
+        char *channel_word = strtok(NULL, " ");
+        long channel = !strcmp(command_word, "ch") && channel_word != NULL ? atoi(channel_word) : 0;
+        valid = channel >= 1 && channel <= LIN_CHANNELS;
+        trigger.channel = channel;
+    }
+    if (!valid)
+    {
+        setColor(C_RED);
+        HostSerial.println("Specify 'match <id> [<byte> <mask> <value>]', 'error [<id>]' or 'missing <id> <ms>', optionally followed by 'ch <channel>'.");
+        setColor(C_RST);
+        return;
+    }
+    uint8_t number = triggers.add(trigger);
+    if (!number)
+    {
+        setColor(C_RED);
+        HostSerial.println("All triggers are in use, clear them first.");
+        setColor(C_RST);
+        return;
+    }
+    setColor(C_YLW);
+    HostSerial.print("Trigger ");
+    HostSerial.print((unsigned long)number);
+    HostSerial.println(" set, frames are only reported around the triggers.");
+    setColor(C_RST);
+}
+
+void printSignalList()
+{
+    if (!signals.size())
+    {
+        HostSerial.println("No signals defined.");
+        return;
+    }
+    //the number is the one in the binary records
+    for (uint8_t i = 0; i < signals.size(); ++i)
+    {
+        const signal_def &s = signals.def(i);
+        HostSerial.print((unsigned long)i);
+        HostSerial.print(" | ");
+        HostSerial.print(s.name);
+        HostSerial.print(": id ");
+        printHex(s.id);
+        HostSerial.print(", bits ");
+        HostSerial.print((unsigned long)s.start_bit);
+        HostSerial.print("..");
+        HostSerial.print((unsigned long)(s.start_bit + s.length - 1));
+        HostSerial.print(", scale ");
+        HostSerial.print(s.scale, 4);
+        HostSerial.print(", offset ");
+        HostSerial.print(s.offset, 4);
+        if (s.channel)
+        {
+            HostSerial.print(", channel ");
+            HostSerial.print((unsigned long)s.channel);
+        }
+        HostSerial.println();
+    }
+    HostSerial.println(config.decode ? "Signals are decoded." : "Decoding is off, see 'decode'.");
+}
+
+//the learned tables of every bus: the ids of the slots with the gap to the next slot
+void printSchedules()
+{
+    if (config.schedule == schedule_off)
+    {
+        HostSerial.println("Schedule monitoring is off.");
+        return;
+    }
+    for (lin_bus *bus : buses)
+    {
+        const schedule_monitor &monitor = schedules[bus->channel - 1];
+        HostSerial.print((unsigned long)bus->channel);
+        if (monitor.learned())
+        {
+            HostSerial.print(": following table ");
+            HostSerial.println((unsigned long)monitor.currentTable() + 1);
+        }
+        else
+            HostSerial.println(": learning the schedule");
+        for (uint8_t index = 0; index < monitor.tableCount(); ++index)
+        {
+            const schedule_table &t = monitor.table(index);
+            HostSerial.print("  table ");
+            HostSerial.print((unsigned long)index + 1);
+            HostSerial.print(", cycle ");
+            HostSerial.print((unsigned long)t.cycle_time);
+            HostSerial.print(" us:");
+            for (uint8_t s = 0; s < t.slot_count; ++s)
+            {
+                HostSerial.print(' ');
+                printHex(t.ids[s]);
+                HostSerial.print('/');
+                HostSerial.print((unsigned long)t.gaps[s]);
+            }
+            HostSerial.println();
+        }
+    }
+    HostSerial.print("Tolerance: ");
+    HostSerial.print(config.schedule_tolerance);
+    HostSerial.print("%, events lost: ");
+    HostSerial.println((unsigned long)schedule_events.overflows);
+}
+
+void printHistorySummary()
+{
+    uint16_t payloads = 0;
+    uint8_t ids = 0;
+    for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+    {
+        payloads += history.payloads(id);
+        ids += history.payloads(id) ? 1 : 0;
+    }
+    HostSerial.print("History: ");
+    HostSerial.print((unsigned long)payloads);
+    HostSerial.print(" payloads of ");
+    HostSerial.print((unsigned long)ids);
+    HostSerial.print(" ids, up to ");
+    HostSerial.print((unsigned long)HISTORY_RING_SIZE);
+    HostSerial.println(" bytes per id.");
+}
+
+void printLimits()
+{
+    bool any = false;
+    for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+    {
+        const id_limit &limit = config.limits[id];
+        if (limit.kind == limit_off)
+            continue;
+        any = true;
+        printHex(id);
+        switch (limit.kind)
+        {
+        case limit_rate:
+            HostSerial.print(" | rate ");
+            HostSerial.print((unsigned long)limit.value);
+            HostSerial.println(" per second");
+            break;
+        case limit_every:
+            HostSerial.print(" | every ");
+            HostSerial.print((unsigned long)limit.value);
+            HostSerial.println(" frames");
+            break;
+        case limit_delta:
+            HostSerial.print(" | delta ");
+            HostSerial.print((unsigned long)limit.value);
+            HostSerial.print(", bytes ");
+            printHex(limit.mask);
+            HostSerial.println();
+            break;
+        }
+    }
+    if (!any)
+        HostSerial.println("No limits set.");
+}
+
+//limit <id>|all off|rate <n>|every <k>|delta <threshold> [<byte mask>]
+void parseLimit(char *id_word)
+{
+    uint8_t id = 0;
+    bool all = strlen(id_word) == 3 && !memcmp(id_word, "all", 3);
+    bool valid = all || parseHex(id_word, 0x3F, id);
+    char *kind_word = strtok(NULL, " ");
+    id_limit limit = {limit_off, 0xFF, 0};
+    size_t len = kind_word != NULL ? strlen(kind_word) : 0;
+    if (len == 4 && !memcmp(kind_word, "rate", 4))
+        limit.kind = limit_rate;
+    else if (len == 5 && !memcmp(kind_word, "every", 5))
+        limit.kind = limit_every;
+    else if (len == 5 && !memcmp(kind_word, "delta", 5))
+        limit.kind = limit_delta;
+    else
+        valid &= len == 3 && !memcmp(kind_word, "off", 3);
+    if (valid && limit.kind != limit_off)
+    {
+        char *value_word = strtok(NULL, " ");
+        long value = value_word != NULL ? atoi(value_word) : 0;
+        valid = value >= 1 && value <= LIMIT_MAX_VALUE && (limit.kind != limit_delta || value <= 0xFF);
+        limit.value = value;
+        if (valid && limit.kind == limit_delta)
+        {
+            char *mask_word = strtok(NULL, " ");
+            if (mask_word != NULL)
+                valid = parseHex(mask_word, 0xFF, limit.mask) && limit.mask;
+        }
+    }
+    if (!valid)
+    {
+        setColor(C_RED);
+        HostSerial.print("Specify 'limit <id>|all off', 'rate <reports per second>', 'every <frames>' or 'delta <change> [<byte mask>]', up to ");
+        HostSerial.print((unsigned long)LIMIT_MAX_VALUE);
+        HostSerial.println(" (a change up to 255).");
+        setColor(C_RST);
+        return;
+    }
+    for (uint8_t i = 0; i < LIN_MEM_SIZE; ++i)
+        if (all || i == id)
+            setLimit(i, limit);
+    setColor(C_YLW);
+    HostSerial.println(limit.kind == limit_off ? "Limit removed." : "Limit set.");
+    setColor(C_RST);
+}
+
+//signal add <name> <id> <start bit> <length> [<scale> [<offset>]] [ch <channel>]
+void parseSignalAdd()
+{
+    signal_def signal = {};
+    signal.scale = 1;
+    char *name = strtok(NULL, " ");
+    bool valid = name != NULL && strlen(name) < SIGNAL_NAME_SIZE && parseHex(strtok(NULL, " "), 0x3F, signal.id);
+    char *start_word = strtok(NULL, " ");
+    char *length_word = strtok(NULL, " ");
+    long start = start_word != NULL ? atoi(start_word) : -1;
+    long length = length_word != NULL ? atoi(length_word) : 0;
+    valid &= start >= 0 && start <= 63 && length >= 1 && length <= 32 && start + length <= 64;
+    char *command_word = strtok(NULL, " ");
+    //scale and offset are optional, in that order
+    float *factors[] = {&signal.scale, &signal.offset};
+    for (float *factor : factors)
+    {
+        if (!valid || command_word == NULL || !strcmp(command_word, "ch"))
+            break;
+        char *end;
+        *factor = strtod(command_word, &end);
+        valid = *end == '\0';
+        command_word = strtok(NULL, " ");
+    }
+    if (valid && command_word != NULL)
+    {
+        char *channel_word = strtok(NULL, " ");
+        long channel = !strcmp(command_word, "ch") && channel_word != NULL ? atoi(channel_word) : 0;
+        valid = channel >= 1 && channel <= LIN_CHANNELS;
+        signal.channel = channel;
+    }
+    if (!valid)
+    {
+        setColor(C_RED);
+        HostSerial.print("Specify 'signal add <name> <id> <start bit> <length> [<scale> [<offset>]]', optionally followed by 'ch <channel>'. Names have up to ");
+        HostSerial.print((unsigned long)SIGNAL_NAME_SIZE - 1);
+        HostSerial.println(" characters, signals up to 32 bits.");
+        setColor(C_RST);
+        return;
+    }
+    strcpy(signal.name, name);
+    signal.start_bit = start;
+    signal.length = length;
+    if (!signals.add(signal))
+    {
+        setColor(C_RED);
+        HostSerial.print("No room for the signal: at most ");
+        HostSerial.print((unsigned long)SIGNAL_COUNT);
+        HostSerial.print(" signals, ");
+        HostSerial.print((unsigned long)SIGNALS_PER_ID);
+        HostSerial.println(" per id.");
+        setColor(C_RST);
+        return;
+    }
+    setColor(C_YLW);
+    HostSerial.print("Signal ");
+    HostSerial.print(signal.name);
+    HostSerial.println(" set.");
+    setColor(C_RST);
+}
+
+bool getCommand(char *buffer)
+{
+    static uint8_t cmd_buf[BUFFER_SIZE];
+    static uint8_t pos = 0;
+    while (HostSerial.available())
+    {
+        char c = HostSerial.read();
+        cmd_buf[pos++] = c;
+        if (c == '\r' || c == '\n')
+        {
+            cmd_buf[pos - 1] = '\0';
+            pos = 0;
+            strcpy(buffer, (char *)cmd_buf);
+            return true;
+        }
+        //overflow protection
+        if (pos == BUFFER_SIZE)
+        {
+            HostSerial.flush();
+            pos = 0;
+        }
+    }
+    return false;
+}
+
+void parseSerial()
+{
+    if (!command_waiting)
+        command_waiting = getCommand(command_buffer);
+    if (command_waiting && line_sent == line.length)
+    {
+        command_waiting = false;
+        char *command_word;
+        command_word = strtok(command_buffer, " ");
+        if (command_word != NULL)
+        {
+            uint8_t len = strlen(command_word);
+            //first word - options:
+            if (len == 4 && !memcmp(command_word, "baud", 4))
+            {
+                command_word = strtok(NULL, " ");
+                //the channel is optional, without it the setting applies to every bus
+                char *channel_word = command_word != NULL ? strtok(NULL, " ") : NULL;
+                long channel = 0;
+                if (channel_word != NULL)
+                {
+                    //a typo must not retune every bus
+                    char *end;
+                    channel = strtol(channel_word, &end, 10);
+                    if (*end || channel < 1)
+                        channel = -1;
+                }
+                uint8_t first = channel ? channel : 1;
+                uint8_t last = channel ? channel : LIN_CHANNELS;
+                if (channel < 0 || channel > LIN_CHANNELS)
+                {
+                    setColor(C_RED);
+                    HostSerial.print("Specify channel between 1 and ");
+                    HostSerial.print((unsigned long)LIN_CHANNELS);
+                    HostSerial.println(".");
+                    setColor(C_RST);
+                }
+                else if (command_word != NULL && strlen(command_word) == 4 && !memcmp(command_word, "auto", 4))
+                {
+                    for (uint8_t ch = first; ch <= last; ++ch)
+                        setAutobaud(ch, true);
+                    setColor(C_YLW);
+                    HostSerial.println("Baudrate is detected from the sync fields.");
+                    setColor(C_RST);
+                }
+                else if (command_word == NULL)
+                {
+                    //the baudrate of every bus, detected so far in auto mode
+                    setColor(C_YLW);
+                    for (lin_bus *bus : buses)
+                    {
+                        HostSerial.print((unsigned long)bus->channel);
+                        HostSerial.print(config.autobaud[bus->channel - 1] ? ": detected baudrate " : ": baudrate ");
+                        HostSerial.println(bus->LIN_BAUD);
+                    }
+                    setColor(C_RST);
+                }
+                else
+                {
+                    long baud = atoi(command_word);
+                    if (baud >= 1000 && baud <= 20000)
+                    {
+                        for (uint8_t ch = first; ch <= last; ++ch)
+                        {
+                            setAutobaud(ch, false);
+                            setBaudrate(ch, baud);
+                        }
+                        setColor(C_YLW);
+                        HostSerial.print("Baudrate changed to ");
+                        HostSerial.println(baud);
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Specify baudrate between 1000 and 20000 or 'auto'.");
+                        setColor(C_RST);
+                    }
+                }
+            }
+            else if (len == 7 && !memcmp(command_word, "timeout", 7))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    long bits = atoi(command_word);
+                    if (bits >= 1 && bits <= 100)
+                    {
+                        setIdleBits(bits);
+                        setColor(C_YLW);
+                        HostSerial.print("Frames end after an idle time of ");
+                        HostSerial.print(bits);
+                        HostSerial.println(" bits.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Specify idle time between 1 and 100 bits.");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify idle time between 1 and 100 bits.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 5 && !memcmp(command_word, "start", 5))
+            {
+                startSniffing();
+                setColor(C_YLW);
+                HostSerial.println("Starting sniffing the LIN bus...");
+                setColor(C_RST);
+            }
+            else if (len == 4 && !memcmp(command_word, "stop", 4))
+            {
+                stopSniffing();
+                setColor(C_YLW);
+                HostSerial.println("Stopped sniffing the LIN bus.");
+                setColor(C_RST);
+            }
+            else if (len == 6 && !memcmp(command_word, "errors", 6))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL)
+                    printErrors();
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    for (lin_bus *bus : buses)
+                    {
+                        memset(bus->parity_errors, 0, sizeof(bus->parity_errors));
+                        memset(bus->checksum_errors, 0, sizeof(bus->checksum_errors));
+                    }
+                    setColor(C_YLW);
+                    HostSerial.println("Error counters cleared.");
+                    setColor(C_RST);
+                }
+                else
+                    HostSerial.println("Please specify no errors option or 'clear'.");
+            }
+            else if (len == 9 && !memcmp(command_word, "malformed", 9))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                    len = strlen(command_word);
+                if (command_word == NULL)
+                    printMalformedCounts();
+                else if (len == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    for (lin_bus *bus : buses)
+                        bus->clearMalformed();
+                    setColor(C_YLW);
+                    HostSerial.println("Malformed frame counters cleared.");
+                    setColor(C_RST);
+                }
+                else if (len == 4 && !memcmp(command_word, "dump", 4))
+                {
+                    command_word = strtok(NULL, " ");
+                    len = command_word != NULL ? strlen(command_word) : 0;
+                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    {
+                        setMalformedDump(true);
+                        setColor(C_YLW);
+                        HostSerial.println("Malformed frames are reported with their bytes.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    {
+                        setMalformedDump(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Malformed frames are only counted.");
+                        setColor(C_RST);
+                    }
+                    else
+                        HostSerial.println("Please specify malformed dump option: 'on' or 'off'.");
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify no option, 'dump on', 'dump off' or 'clear'.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 6 && !memcmp(command_word, "timing", 6))
+            {
+                command_word = strtok(NULL, " ");
+                uint8_t id = LIN_MEM_SIZE;
+                long channel = 0;
+                bool valid = true;
+                if (command_word != NULL && strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    for (lin_bus *bus : buses)
+                        bus->clearTiming();
+                    setColor(C_YLW);
+                    HostSerial.println("Timing measurements cleared.");
+                    setColor(C_RST);
+                }
+                else
+                {
+                    //[<id>] [ch <channel>]
+                    if (command_word != NULL && strcmp(command_word, "ch"))
+                    {
+                        valid = parseHex(command_word, 0x3F, id);
+                        command_word = strtok(NULL, " ");
+                    }
+                    if (valid && command_word != NULL)
+                    {
+                        char *channel_word = strtok(NULL, " ");
+                        channel = !strcmp(command_word, "ch") && channel_word != NULL ? atoi(channel_word) : 0;
+                        valid = channel >= 1 && channel <= LIN_CHANNELS;
+                    }
+                    if (valid)
+                        printTiming(id, channel);
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Specify 'timing [<id>] [ch <channel>]' or 'timing clear'.");
+                        setColor(C_RST);
+                    }
+                }
+            }
+            else if (len == 4 && !memcmp(command_word, "show", 4))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: never, change, always
+                    frame_option_t option = option_undefined;
+                    len = strlen(command_word);
+                    if (len == 5 && !memcmp(command_word, "never", 5))
+                        option = option_never;
+                    else if (len == 6 && !memcmp(command_word, "change", 6))
+                        option = option_change;
+                    else if (len == 6 && !memcmp(command_word, "always", 6))
+                        option = option_always;
+                    if (option != option_undefined)
+                    {
+                        command_word = strtok(NULL, " ");
+                        if (command_word != NULL)
+                        {
+                            len = strlen(command_word);
+                            if (len == 3 && !memcmp(command_word, "all", 3))
+                            {
+                                for (uint8_t i = 0; i < LIN_MEM_SIZE; ++i)
+                                    setFrameOption(i, option);
+
+                                setColor(C_YLW);
+                                switch (option)
+                                {
+                                case option_never:
+
+                                    HostSerial.println("All frames are set to never show.");
+                                    break;
+                                case option_change:
+                                    HostSerial.println("All frames are set to show on change.");
+                                    break;
+                                case option_always:
+                                    HostSerial.println("All frames are set to always show.");
+                                default:
+                                    break;
+                                }
+                                setColor(C_RST);
+                            }
+                            else //ignore some frames
+                                while (command_word != NULL)
+                                {
+                                    len = strlen(command_word);
+                                    bool alphanumeric = true;
+                                    for (uint8_t i = 0; i < len; ++i)
+                                        alphanumeric &= isHexadecimalDigit(command_word[i]);
+                                    if (alphanumeric)
+                                    {
+                                        long id = strtol(command_word, NULL, 16);
+                                        if (((id >= 1 && id <= 0x3F) || (id == 0 && command_word[0] == '0')))
+                                        {
+                                            setColor(C_YLW);
+                                            setFrameOption(id, option);
+                                            HostSerial.print("Frame ID ");
+                                            printHex(id);
+                                            switch (option)
+                                            {
+                                            case option_never:
+                                                HostSerial.println(" is set to never show.");
+                                                break;
+                                            case option_change:
+                                                HostSerial.println(" is set to show on change.");
+                                                break;
+                                            case option_always:
+                                                HostSerial.println(" is set to always show.");
+                                            default:
                                                 break;
                                             }
                                             setColor(C_RST);
@@ -412,16 +2370,16 @@ void parseSerial()
                                         else
                                         {
                                             setColor(C_RED);
-                                            Serial.print(command_word);
-                                            Serial.println(" is not a correct frame ID.");
+                                            HostSerial.print(command_word);
+                                            HostSerial.println(" is not a correct frame ID.");
                                             setColor(C_RST);
                                         }
                                     }
                                     else
                                     {
                                         setColor(C_RED);
-                                        Serial.print(command_word);
-                                        Serial.println(" is not a hexadecimal frame ID.");
+                                        HostSerial.print(command_word);
+                                        HostSerial.println(" is not a hexadecimal frame ID.");
                                         setColor(C_RST);
                                     }
                                     command_word = strtok(NULL, " ");
@@ -430,52 +2388,503 @@ void parseSerial()
                         else
                         {
                             setColor(C_RED);
-                            Serial.println("Specify IDs of frames or use toe option 'all'.");
+                            HostSerial.println("Specify IDs of frames or use toe option 'all'.");
                             setColor(C_RST);
                         }
                     }
                     else
                     {
                         setColor(C_RED);
-                        Serial.println("Specify 'never'/'change'/'always' after the show command.");
+                        HostSerial.println("Specify 'never'/'change'/'always' after the show command.");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify 'never'/'change'/'always' after the show command, followed by 'all' or IDs of frames.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 4 && !memcmp(command_word, "stub", 4))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: on / off
+                    len = strlen(command_word);
+                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    {
+                        setStub(true);
+                        setColor(C_YLW);
+                        HostSerial.println("Message stubs are turned on.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    {
+                        setStub(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Message stubs are turned off.");
+                        setColor(C_RST);
+                    }
+                    else
+                        HostSerial.println("Please specify one of the stub options: 'on' or 'off'.");
+                }
+                else
+                    HostSerial.println("Please specify stub option: 'on' or 'off'.");
+            }
+            else if (len == 8 && !memcmp(command_word, "checksum", 8))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: on / off
+                    len = strlen(command_word);
+                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    {
+                        setChk(true);
+                        setColor(C_YLW);
+                        HostSerial.println("Checksum showing is turned on.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    {
+                        setChk(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Checksum showing is turned off.");
+                        setColor(C_RST);
+                    }
+                    else
+                        HostSerial.println("Please specify one of the checksum options: 'on' or 'off'.");
+                }
+                else
+                    HostSerial.println("Please specify checksum option: 'on' or 'off'.");
+            }
+            else if (len == 4 && !memcmp(command_word, "time", 4))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: on / off
+                    len = strlen(command_word);
+                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    {
+                        setTimestamps(true);
+                        setColor(C_YLW);
+                        HostSerial.println("Timestamp showing is turned on.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    {
+                        setTimestamps(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Timestamp showing is turned off.");
+                        setColor(C_RST);
+                    }
+                    else
+                        HostSerial.println("Please specify one of the time options: 'on' or 'off'.");
+                }
+                else
+                    HostSerial.println("Please specify time option: 'on' or 'off'.");
+            }
+            else if (len == 5 && !memcmp(command_word, "color", 5))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: on / off
+                    len = strlen(command_word);
+                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    {
+                        setColoring(true);
+                        setColor(C_YLW);
+                        HostSerial.println("Message coloring turned on.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    {
+                        setColoring(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Message coloring is turned off.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Please specify one of the color options: 'on' or 'off'.");
                         setColor(C_RST);
                     }
                 }
                 else
                 {
                     setColor(C_RED);
-                    Serial.println("Specify 'never'/'change'/'always' after the show command, followed by 'all' or IDs of frames.");
+                    HostSerial.println("Please specify color option: 'on' or 'off'.");
                     setColor(C_RST);
                 }
             }
-            else if (len == 4 && !memcmp(command_word, "stub", 4))
+            else if (len == 6 && !memcmp(command_word, "output", 6))
             {
                 command_word = strtok(NULL, " ");
                 if (command_word != NULL)
                 {
-                    //OPTIONS: on / off
+                    //OPTIONS: text / binary
                     len = strlen(command_word);
-                    if (len == 2 && !memcmp(command_word, "on", 2))
+                    if (len == 4 && !memcmp(command_word, "text", 4))
                     {
-                        setStub(true);
+                        setOutput(output_text);
                         setColor(C_YLW);
-                        Serial.println("Message stubs are turned on.");
+                        HostSerial.println("Frames are reported as text.");
                         setColor(C_RST);
                     }
-                    else if (len == 3 && !memcmp(command_word, "off", 3))
+                    else if (len == 6 && !memcmp(command_word, "binary", 6))
                     {
-                        setStub(false);
+                        //the table view is text
+                        setView(view_stream);
+                        setOutput(output_binary);
                         setColor(C_YLW);
-                        Serial.println("Message stubs are turned off.");
+                        HostSerial.println("Frames are reported as binary records.");
                         setColor(C_RST);
                     }
                     else
-                        Serial.println("Please specify one of the stub options: 'on' or 'off'.");
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Please specify one of the output options: 'text' or 'binary'.");
+                        setColor(C_RST);
+                    }
                 }
                 else
-                    Serial.println("Please specify stub option: 'on' or 'off'.");
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Please specify output option: 'text' or 'binary'.");
+                    setColor(C_RST);
+                }
             }
-            else if (len == 8 && !memcmp(command_word, "checksum", 8))
+            else if (len == 8 && !memcmp(command_word, "overflow", 8))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                {
+                    //OPTIONS: oldest / unchanged / coalesce
+                    len = strlen(command_word);
+                    if (len == 6 && !memcmp(command_word, "oldest", 6))
+                    {
+                        setOverflow(overflow_oldest);
+                        setColor(C_YLW);
+                        HostSerial.println("On output overflow the oldest frames are dropped.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 9 && !memcmp(command_word, "unchanged", 9))
+                    {
+                        setOverflow(overflow_unchanged);
+                        setColor(C_YLW);
+                        HostSerial.println("On output overflow unchanged frames are dropped first.");
+                        setColor(C_RST);
+                    }
+                    else if (len == 8 && !memcmp(command_word, "coalesce", 8))
+                    {
+                        setOverflow(overflow_coalesce);
+                        setColor(C_YLW);
+                        HostSerial.println("On output overflow frames are coalesced per ID.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Please specify one of the overflow options: 'oldest', 'unchanged' or 'coalesce'.");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Please specify overflow option: 'oldest', 'unchanged' or 'coalesce'.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 5 && !memcmp(command_word, "stats", 5))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL)
+                    printStats();
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    stats.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("Statistics cleared.");
+                    setColor(C_RST);
+                }
+                else if (strlen(command_word) == 3 && !memcmp(command_word, "off", 3))
+                {
+                    setStatsPeriod(0);
+                    setColor(C_YLW);
+                    HostSerial.println("Periodic statistics are turned off.");
+                    setColor(C_RST);
+                }
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "every", 5))
+                {
+                    command_word = strtok(NULL, " ");
+                    long seconds = command_word != NULL ? atoi(command_word) : 0;
+                    if (seconds >= 1 && seconds <= 3600)
+                    {
+                        setStatsPeriod(seconds);
+                        setColor(C_YLW);
+                        HostSerial.print("Statistics are reported every ");
+                        HostSerial.print(seconds);
+                        HostSerial.println(" s.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Specify a period between 1 and 3600 seconds.");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                    HostSerial.println("Please specify no stats option, 'clear', 'every <seconds>' or 'off'.");
+            }
+            else if (len == 4 && !memcmp(command_word, "view", 4))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                    len = strlen(command_word);
+                if (command_word == NULL)
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify 'stream', 'table' or 'refresh <ms>'.");
+                    setColor(C_RST);
+                }
+                else if (len == 6 && !memcmp(command_word, "stream", 6))
+                {
+                    setView(view_stream);
+                    setColor(C_YLW);
+                    HostSerial.println("Frames are reported as a stream.");
+                    setColor(C_RST);
+                }
+                else if (len == 5 && !memcmp(command_word, "table", 5))
+                {
+                    if (config.output != output_text)
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("The table view needs text output.");
+                        setColor(C_RST);
+                    }
+                    else
+                        setView(view_table); //clears the screen, no reply
+                }
+                else if (len == 7 && !memcmp(command_word, "refresh", 7))
+                {
+                    command_word = strtok(NULL, " ");
+                    long ms = command_word != NULL ? atoi(command_word) : 0;
+                    if (ms >= TABLE_MIN_REFRESH && ms <= TABLE_MAX_REFRESH)
+                    {
+                        setViewRefresh(ms);
+                        setColor(C_YLW);
+                        HostSerial.print("The table is updated every ");
+                        HostSerial.print(ms);
+                        HostSerial.println(" ms.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.print("Specify the refresh between ");
+                        HostSerial.print((long)TABLE_MIN_REFRESH);
+                        HostSerial.print(" and ");
+                        HostSerial.print((long)TABLE_MAX_REFRESH);
+                        HostSerial.println(" ms.");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify 'stream', 'table' or 'refresh <ms>'.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 5 && !memcmp(command_word, "tasks", 5))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL)
+                    printTasks();
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    scheduler.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("Task times cleared.");
+                    setColor(C_RST);
+                }
+                else
+                    HostSerial.println("Please specify no tasks option or 'clear'.");
+            }
+            else if (len == 7 && !memcmp(command_word, "trigger", 7))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL || (strlen(command_word) == 4 && !memcmp(command_word, "list", 4)))
+                    printTriggers();
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    triggers.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("Triggers cleared, frames are reported live.");
+                    setColor(C_RST);
+                }
+                else if (strlen(command_word) == 6 && !memcmp(command_word, "frames", 6))
+                {
+                    char *after_word;
+                    long before = (command_word = strtok(NULL, " ")) != NULL ? atoi(command_word) : -1;
+                    long after = (after_word = strtok(NULL, " ")) != NULL ? atoi(after_word) : -1;
+                    //the frames before and the ones coming in while the dump is sent have to fit into the ring
+                    if (before >= 0 && after >= 0 && before + after <= CAPTURE_SIZE / 2)
+                    {
+                        triggers.before = before;
+                        triggers.after = after;
+                        setColor(C_YLW);
+                        HostSerial.print("Triggers dump ");
+                        HostSerial.print(before);
+                        HostSerial.print(" frames before and ");
+                        HostSerial.print(after);
+                        HostSerial.println(" after.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.print("Specify the frames before and after, together at most ");
+                        HostSerial.print((unsigned long)CAPTURE_SIZE / 2);
+                        HostSerial.println(".");
+                        setColor(C_RST);
+                    }
+                }
+                else
+                    parseTrigger(command_word);
+            }
+            else if (len == 6 && !memcmp(command_word, "filter", 6))
+            {
+                //the rest of the line is the expression
+                command_word = strtok(NULL, "");
+                while (command_word != NULL && *command_word == ' ')
+                    ++command_word;
+                if (command_word == NULL || !*command_word)
+                {
+                    if (filter.active())
+                    {
+                        HostSerial.print("Filter: ");
+                        HostSerial.print(filter.text());
+                        HostSerial.print(" (");
+                        HostSerial.print((unsigned long)filter.size());
+                        HostSerial.println(" instructions)");
+                    }
+                    else
+                        HostSerial.println("No filter set.");
+                }
+                else if (!strcmp(command_word, "off"))
+                {
+                    filter.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("Filter removed.");
+                    setColor(C_RST);
+                }
+                else if (filter.compile(command_word))
+                {
+                    setColor(C_YLW);
+                    HostSerial.print("Only frames matching ");
+                    HostSerial.print(filter.text());
+                    HostSerial.println(" are reported.");
+                    setColor(C_RST);
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.print("Filter error at: ");
+                    HostSerial.println(*filter.error ? filter.error : "end of the expression");
+                    setColor(C_RST);
+                }
+            }
+            else if ((len == 7 && !memcmp(command_word, "history", 7)) || (len == 4 && !memcmp(command_word, "dump", 4)))
+            {
+                bool dump = len == 4;
+                command_word = dump ? NULL : strtok(NULL, " ");
+                uint8_t id = 0;
+                if (command_word == NULL && !dump)
+                    printHistorySummary();
+                else if (command_word != NULL && strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    history.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("History cleared.");
+                    setColor(C_RST);
+                }
+                else if (!dump && !parseHex(command_word, 0x3F, id))
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify 'history <id>', 'history clear' or 'dump' for every id.");
+                    setColor(C_RST);
+                }
+                else if (config.view == view_table)
+                {
+                    setColor(C_RED);
+                    HostSerial.println("The history is read back in the stream view.");
+                    setColor(C_RST);
+                }
+                else
+                    history_dump.start(dump ? 0 : id, dump ? LIN_MEM_SIZE - 1 : id); //sent with the reports, see printHistory
+            }
+            else if (len == 5 && !memcmp(command_word, "limit", 5))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL)
+                    printLimits();
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+                        setLimit(id, {limit_off, 0xFF, 0});
+                    setColor(C_YLW);
+                    HostSerial.println("Limits cleared.");
+                    setColor(C_RST);
+                }
+                else
+                    parseLimit(command_word);
+            }
+            else if (len == 6 && !memcmp(command_word, "signal", 6))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word == NULL || (strlen(command_word) == 4 && !memcmp(command_word, "list", 4)))
+                    printSignalList();
+                else if (strlen(command_word) == 3 && !memcmp(command_word, "add", 3))
+                    parseSignalAdd();
+                else if (strlen(command_word) == 3 && !memcmp(command_word, "del", 3))
+                {
+                    command_word = strtok(NULL, " ");
+                    if (command_word != NULL && signals.remove(command_word))
+                    {
+                        setColor(C_YLW);
+                        HostSerial.println("Signal removed.");
+                        setColor(C_RST);
+                    }
+                    else
+                    {
+                        setColor(C_RED);
+                        HostSerial.println("Specify the name of a defined signal.");
+                        setColor(C_RST);
+                    }
+                }
+                else if (strlen(command_word) == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    signals.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("Signals removed.");
+                    setColor(C_RST);
+                }
+                else
+                {
+                    setColor(C_RED);
+                    HostSerial.println("Specify 'list', 'add', 'del <name>' or 'clear'.");
+                    setColor(C_RST);
+                }
+            }
+            else if (len == 6 && !memcmp(command_word, "decode", 6))
             {
                 command_word = strtok(NULL, " ");
                 if (command_word != NULL)
@@ -484,25 +2893,25 @@ void parseSerial()
                     len = strlen(command_word);
                     if (len == 2 && !memcmp(command_word, "on", 2))
                     {
-                        setChk(true);
+                        setDecode(true);
                         setColor(C_YLW);
-                        Serial.println("Checksum showing is turned on.");
+                        HostSerial.println("Ids with signals report the signals that changed.");
                         setColor(C_RST);
                     }
                     else if (len == 3 && !memcmp(command_word, "off", 3))
                     {
-                        setChk(false);
+                        setDecode(false);
                         setColor(C_YLW);
-                        Serial.println("Checksum showing is turned off.");
+                        HostSerial.println("Ids with signals report the frames.");
                         setColor(C_RST);
                     }
                     else
-                        Serial.println("Please specify one of the checksum options: 'on' or 'off'.");
+                        HostSerial.println("Please specify one of the decode options: 'on' or 'off'.");
                 }
                 else
-                    Serial.println("Please specify checksum option: 'on' or 'off'.");
+                    HostSerial.println("Please specify decode option: 'on' or 'off'.");
             }
-            else if (len == 5 && !memcmp(command_word, "color", 5))
+            else if (len == 4 && !memcmp(command_word, "diag", 4))
             {
                 command_word = strtok(NULL, " ");
                 if (command_word != NULL)
@@ -511,82 +2920,291 @@ void parseSerial()
                     len = strlen(command_word);
                     if (len == 2 && !memcmp(command_word, "on", 2))
                     {
-                        setColoring(true);
+                        setTransport(true);
                         setColor(C_YLW);
-                        Serial.println("Message coloring turned on.");
+                        HostSerial.println("Diagnostic frames are reported as messages.");
                         setColor(C_RST);
                     }
                     else if (len == 3 && !memcmp(command_word, "off", 3))
                     {
-                        setColoring(false);
+                        setTransport(false);
+                        setColor(C_YLW);
+                        HostSerial.println("Diagnostic frames are reported as frames.");
+                        setColor(C_RST);
+                    }
+                    else
+                        HostSerial.println("Please specify one of the diag options: 'on' or 'off'.");
+                }
+                else
+                    HostSerial.println("Please specify diag option: 'on' or 'off'.");
+            }
+            else if (len == 8 && !memcmp(command_word, "schedule", 8))
+            {
+                command_word = strtok(NULL, " ");
+                if (command_word != NULL)
+                    len = strlen(command_word);
+                if (command_word == NULL)
+                    printSchedules();
+                else if (len == 2 && !memcmp(command_word, "on", 2))
+                {
+                    setSchedule(schedule_on);
+                    setColor(C_YLW);
+                    HostSerial.println("Schedule anomalies are reported between the frames.");
+                    setColor(C_RST);
+                }
+                else if (len == 4 && !memcmp(command_word, "only", 4))
+                {
+                    setSchedule(schedule_only);
+                    setColor(C_YLW);
+                    HostSerial.println("Only schedule anomalies and frame errors are reported.");
+                    setColor(C_RST);
+                }
+                else if (len == 3 && !memcmp(command_word, "off", 3))
+                {
+                    setSchedule(schedule_off);
+                    setColor(C_YLW);
+                    HostSerial.println("Schedule monitoring is off.");
+                    setColor(C_RST);
+                }
+                else if (len == 5 && !memcmp(command_word, "clear", 5))
+                {
+                    for (schedule_monitor &monitor : schedules)
+                        monitor.clear();
+                    setColor(C_YLW);
+                    HostSerial.println("The schedules are learned anew.");
+                    setColor(C_RST);
+                }
+                else if (len == 9 && !memcmp(command_word, "tolerance", 9))
+                {
+                    command_word = strtok(NULL, " ");
+                    long percent = command_word != NULL ? atoi(command_word) : 0;
+                    if (percent >= 1 && percent <= 100)
+                    {
+                        setScheduleTolerance(percent);
                         setColor(C_YLW);
-                        Serial.println("Message coloring is turned off.");
+                        HostSerial.print("Frames may be ");
+                        HostSerial.print(percent);
+                        HostSerial.println("% of the gap early or late.");
                         setColor(C_RST);
                     }
                     else
                     {
                         setColor(C_RED);
-                        Serial.println("Please specify one of the color options: 'on' or 'off'.");
+                        HostSerial.println("Specify the tolerance between 1 and 100 percent.");
                         setColor(C_RST);
                     }
                 }
                 else
                 {
                     setColor(C_RED);
-                    Serial.println("Please specify color option: 'on' or 'off'.");
+                    HostSerial.println("Specify 'on', 'only', 'off', 'clear' or 'tolerance <percent>'.");
                     setColor(C_RST);
                 }
             }
             else if (len == 4 && !memcmp(command_word, "save", 4))
             {
+                //finished between the frames, reported then
                 saveSettings();
                 setColor(C_YLW);
-                Serial.println("Settings saved.");
+                HostSerial.println("Saving settings...");
                 setColor(C_RST);
             }
             else //error
             {
                 setColor(C_RED);
-                Serial.print("Unknown command: ");
-                Serial.println(command_word);
+                HostSerial.print("Unknown command: ");
+                HostSerial.println(command_word);
                 setColor(C_RST);
             }
         }
+        endText();
+    }
+}
+
+//the config as it was saved before the settings image, at address 4. Only these fields existed then
+struct old_config_t
+{
+    frame_option_t frame_verbosity[LIN_MEM_SIZE];
+    uint8_t stub; //bool
+    long baudrate;
+    uint8_t clr;
+    uint8_t chk;
+};
+
+//the fields of the old config replace the defaults
+void loadOldConfig()
+{
+    HostSerial.println("Loading settings...");
+    old_config_t old;
+    for (uint32_t i = 0; i < sizeof(old_config_t); ++i)
+        ((byte *)&old)[i] = hal::storageRead(4 + i);
+    for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+        setFrameOption(id, (uint32_t)old.frame_verbosity[id] <= option_always ? old.frame_verbosity[id] : option_undefined);
+    setStub(old.stub == 1);
+    for (uint8_t ch = 1; ch <= LIN_CHANNELS; ++ch)
+        setBaudrate(ch, old.baudrate >= 1000 && old.baudrate <= 20000 ? old.baudrate : 9600);
+    setColoring(old.clr == 1);
+    setChk(old.chk == 1);
+}
+
+//the urgent task: every bus takes a bounded number of bytes per call, none of them waits for another
+void receive()
+{
+    for (lin_bus *bus : buses)
+        bus->loop();
+}
+
+//the ends the frames do not show: triggers, stopped schedules, diagnostic messages without their next frame
+void pollMonitors()
+{
+    triggers.poll(hal::timestamp());
+    uint8_t channel, id;
+    if (limiter.due(hal::timestamp(), channel, id))
+        queueSuppressed(channel, id);
+    if (config.schedule != schedule_off)
+        for (lin_bus *bus : buses)
+        {
+            schedule_event event;
+            if (bus->LIN_state != stopped && schedules[bus->channel - 1].poll(hal::timestamp(), event))
+                queueScheduleEvent(bus->channel, event);
+        }
+    if (config.transport)
+        for (tp_reassembler &transport : transports)
+            transport.poll(hal::timestamp());
+}
+
+//a page of the settings being saved. A bus that never goes idle (noise) does not hold the save back for good,
+//its bytes wait in the USART
+void writeSettings()
+{
+    if (settings.writing() && (busesIdle() || hal::timestamp() - settings_wait > SETTINGS_MAX_DEFER))
+    {
+        settings_step_t result = settings.step();
+        settings_wait = hal::timestamp();
+        if (result != settings_writing)
+            settings_result = result;
     }
 }
 
+//a command reply waiting for the host serial port
+void yieldToReception() { scheduler.yield(); }
+
 void setup()
 {
-    LIN_sniffer::init(MarkNewLoop, MarkNewFrame, MarkChangedFrame, MarkUnchangedFrame);
-    Serial.begin(115200);
+    hal::timestampInit();
+    hal::cyclesInit();
+    for (lin_bus *bus : buses)
+        bus->init(MarkNewLoop, MarkNewFrame, MarkChangedFrame, MarkUnchangedFrame, MarkErrorFrame, MarkDiagnosticFrame, MarkMalformedFrame);
+    for (tp_reassembler &transport : transports)
+        transport.MarkMessage = MarkMessage;
+    scheduler.setUrgent("reception", receive);
+    scheduler.add("commands", parseSerial);
+    scheduler.add("monitors", pollMonitors);
+    scheduler.add("settings", writeSettings);
+    scheduler.add("output", drainOutput);
+    HostSerial.waiting = yieldToReception;
+    HostSerial.begin(SERIAL_BAUD);
 
-    //config loading
-    if (dueFlashStorage.read(0) == 0)
+    //config loading. Fields a saved config does not have yet are 0xFF, like erased flash.
+    //Settings saved before the settings image are at address 4, a zero at address 0 marks them
+    byte mem[sizeof(config_t)];
+    bool loaded = settings.load(mem, signals);
+    bool migrated = !loaded && hal::storageRead(0) == 0;
+    if (loaded)
     {
-        Serial.println("Loading settings...");
-        byte mem[sizeof(config_t)];
-        for (uint32_t i = 0; i < sizeof(config_t); ++i)
+        HostSerial.println("Loading settings...");
+        memcpy(&config, mem, sizeof(config_t));
+        long first_baud = config.baudrate >= 1000 && config.baudrate <= 20000 ? config.baudrate : 9600;
+        for (uint8_t ch = 1; ch <= LIN_CHANNELS; ++ch)
         {
-            mem[i] = dueFlashStorage.read(4 + i);
+            //settings saved before every bus had its own baudrate take the one of channel 1
+            long baud = ch == 1 ? first_baud : config.other_baudrates[ch - 2];
+            setBaudrate(ch, baud >= 1000 && baud <= 20000 ? baud : first_baud);
+            //settings saved before the baudrate detection was added, or before every bus had it
+            setAutobaud(ch, mem[offsetof(config_t, autobaud) + ch - 1] == 1);
+        }
+        //settings saved before the idle time was added
+        if (config.idle_bits >= 1 && config.idle_bits <= 100)
+            setIdleBits(config.idle_bits);
+        else
+            setIdleBits(LIN_DEFAULT_IDLE_BITS);
+        if (config.output != output_binary)
+            setOutput(output_text);
+        if (config.overflow > overflow_coalesce)
+            setOverflow(overflow_oldest);
+        setColoring(mem[offsetof(config_t, clr)] == 1);
+        setChk(mem[offsetof(config_t, chk)] == 1);
+        //settings saved before the timestamps were added
+        setTimestamps(mem[offsetof(config_t, timestamps)] == 1);
+        //settings saved before the periodic statistics were added
+        setStatsPeriod(config.stats_period >= 1 && config.stats_period <= 3600 ? config.stats_period : 0);
+        //settings saved before the signals were added
+        setDecode(mem[offsetof(config_t, decode)] == 1);
+        //settings saved before the schedule monitoring was added
+        setSchedule(config.schedule <= schedule_only ? config.schedule : schedule_off);
+        setScheduleTolerance(config.schedule_tolerance >= 1 && config.schedule_tolerance <= 100 ? config.schedule_tolerance : SCHEDULE_DEFAULT_TOLERANCE);
+        //settings saved before the transport layer was added
+        setTransport(mem[offsetof(config_t, transport)] == 1);
+        //settings saved before the malformed frames were classified
+        setMalformedDump(mem[offsetof(config_t, malformed_dump)] == 1);
+        //settings saved before the table view was added
+        setView(config.view == view_table && config.output == output_text ? view_table : view_stream);
+        setViewRefresh(config.view_refresh >= TABLE_MIN_REFRESH && config.view_refresh <= TABLE_MAX_REFRESH ? config.view_refresh : TABLE_DEFAULT_REFRESH);
+        //settings saved before the limits were added
+        for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+        {
+            id_limit limit = config.limits[id];
+            bool valid = limit.kind >= limit_rate && limit.kind <= limit_delta && limit.value >= 1 && limit.value <= LIMIT_MAX_VALUE &&
+                         (limit.kind != limit_delta || (limit.value <= 0xFF && limit.mask));
+            setLimit(id, valid ? limit : id_limit{limit_off, 0xFF, 0});
         }
-        memcpy(&config, mem, sizeof(config_t));
-        setBaudrate(config.baudrate);
     }
     else
     {
         //default settings
-        setBaudrate(9600);
+        for (uint8_t ch = 1; ch <= LIN_CHANNELS; ++ch)
+            setBaudrate(ch, 9600);
+        setIdleBits(LIN_DEFAULT_IDLE_BITS);
         setChk(false);
         setStub(true);
         setColoring(false);
+        setOutput(output_text);
+        setOverflow(overflow_oldest);
+        setTimestamps(true);
+        setStatsPeriod(0);
+        setDecode(false);
+        setSchedule(schedule_off);
+        setScheduleTolerance(SCHEDULE_DEFAULT_TOLERANCE);
+        setTransport(false);
+        setMalformedDump(false);
+        setView(view_stream);
+        setViewRefresh(TABLE_DEFAULT_REFRESH);
+        for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+            setLimit(id, {limit_off, 0xFF, 0});
+        for (uint8_t ch = 1; ch <= LIN_CHANNELS; ++ch)
+            setAutobaud(ch, false);
+        //saved signals replace the compiled in ones
+        if (!migrated || !signals.loadOld())
+            signals.add(SIGNAL_TABLE);
+    }
+    //the old layout is written as an image once the buses run, it stays where it is until then
+    if (migrated)
+    {
+        loadOldConfig();
+        saveSettings();
     }
+    stats.clear();
     setColor(C_GRN);
-    Serial.println("Ready.");
+    HostSerial.println("Ready.");
     setColor(C_RST);
+    endText();
 }
 
 void loop()
 {
-    parseSerial();
-    LIN_sniffer::loop();
+    uint32_t start = hal::cycles();
+    scheduler.run();
+    stats.tick(hal::cycles() - start);
+    if (!stats_pending && stats.periodDone(stats_result) && config.view == view_stream)
+        stats_pending = 1 + LIN_CHANNELS;
 }
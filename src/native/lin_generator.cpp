@@ -0,0 +1,202 @@
+#ifndef ARDUINO
+#include "lin_generator.h"
+#include "native_hal.h"
+
+#define GEN_MATCH_WINDOW 8 //how many frames can be missing in a row before a reported frame is taken as corrupted
+
+lin_generator::lin_generator(const generator_config &_config, const std::vector<generator_slot> &_schedule)
+    : config(_config), schedule(_schedule), rng(_config.seed)
+{
+    if (config.jitter > 0.25)
+        config.jitter = 0.25; //edges must not swap places
+}
+
+uint8_t lin_generator::protectedId(uint8_t id)
+{
+    uint8_t p0 = ((id >> 0) ^ (id >> 1) ^ (id >> 2) ^ (id >> 4)) & 1;
+    uint8_t p1 = ~((id >> 1) ^ (id >> 3) ^ (id >> 4) ^ (id >> 5)) & 1;
+    return id | (p0 << 6) | (p1 << 7);
+}
+
+uint8_t lin_generator::checksum(const uint8_t *data, uint8_t length, uint8_t pid)
+{
+    uint16_t sum = pid;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+        sum += data[i];
+        if (sum > 0xFF)
+            sum -= 0xFF;
+    }
+    return ~sum;
+}
+
+double lin_generator::random(double low, double high)
+{
+    return std::uniform_real_distribution<double>(low, high)(rng);
+}
+
+//keeps the bus at a level for a number of bits, only level changes become edges
+void lin_generator::queueLevel(bool new_level, double bits)
+{
+    if (new_level != level)
+    {
+        uint64_t edge = time + random(-config.jitter, config.jitter) * bit_ns;
+        if (edge <= last_edge)
+            edge = last_edge + 1;
+        sim::queueEdge(config.channel, edge, new_level);
+        last_edge = edge;
+        level = new_level;
+    }
+    time += bits * bit_ns;
+}
+
+void lin_generator::queueByte(uint8_t value, bool framing_error)
+{
+    queueLevel(false, 1); //start bit
+    for (int i = 0; i < 8; ++i)
+        queueLevel((value >> i) & 1, 1);
+    //a low stop bit, the line has to go high before the next start bit
+    if (framing_error)
+        queueLevel(false, 1);
+    queueLevel(true, 1); //stop bit
+}
+
+//the diagnostic frames carry transport layer messages: requests and responses of every length up to GEN_DIAG_MAX_LENGTH,
+//as single frames or as a first frame and consecutive frames
+void lin_generator::diagnosticData(uint8_t direction, uint8_t *data)
+{
+    uint32_t number = diag_messages[direction];
+    uint16_t length = 1 + number * 13 % GEN_DIAG_MAX_LENGTH;
+    uint16_t &sent = diag_sent[direction];
+    uint8_t &sequence = diag_sequence[direction];
+    //a service id, then bytes counting up from the message number
+    auto byte = [&](uint16_t i) -> uint8_t { return i ? number + i : (direction ? 0x62 : 0x22); };
+    data[0] = GEN_DIAG_NAD;
+    memset(data + 1, 0xFF, 7);
+    if (length <= 6)
+    {
+        data[1] = length;
+        for (uint8_t i = 0; i < length; ++i)
+            data[2 + i] = byte(i);
+        sent = length;
+    }
+    else if (sent == 0)
+    {
+        data[1] = 0x10 | length >> 8;
+        data[2] = length;
+        for (uint8_t i = 0; i < 5; ++i)
+            data[3 + i] = byte(i);
+        sent = 5;
+        sequence = 1;
+    }
+    else
+    {
+        data[1] = 0x20 | sequence;
+        sequence = (sequence + 1) & 0x0F;
+        for (uint8_t i = 0; i < 6 && sent < length; ++i)
+            data[2 + i] = byte(sent++);
+    }
+    if (sent == length)
+    {
+        ++diag_messages[direction];
+        sent = 0;
+    }
+}
+
+uint64_t lin_generator::queueFrame()
+{
+    const generator_slot &s = schedule[slot];
+    slot = (slot + 1) % schedule.size();
+    ++frame_number;
+
+    generated_frame frame;
+    uint8_t pid = protectedId(s.id);
+    uint8_t data[8];
+    //the first byte counts the schedule loops, the others change now and then
+    data[0] = frame_number / schedule.size();
+    for (uint8_t i = 1; i < s.length; ++i)
+        data[i] = (frame_number / (schedule.size() * (i + 1))) ^ s.id;
+    if ((s.id == 0x3C || s.id == 0x3D) && s.length == 8)
+        diagnosticData(s.id - 0x3C, data);
+    frame.bytes[0] = 0x55;
+    frame.bytes[1] = pid;
+    memcpy(frame.bytes + 2, data, s.length);
+    //diagnostic frames always use the classic checksum
+    frame.bytes[s.length + 2] = checksum(data, s.length, s.id >= 0x3C ? 0 : pid);
+    frame.count = s.length + 3;
+    frame.truncated = random(0, 1) < config.truncate_rate;
+    if (frame.truncated)
+    {
+        //anything from a missing response to a missing checksum
+        frame.count = 2 + std::uniform_int_distribution<int>(0, s.length)(rng);
+        ++counters.truncated;
+    }
+
+    time = bus_time;
+    level = true;
+    const double nominal_ns = 1e9 / config.baud;
+
+    //master: optional glitch, break, delimiter, sync and pid
+    bit_ns = nominal_ns * (1 + random(-config.drift, config.drift));
+    if (random(0, 1) < config.glitch_rate)
+    {
+        queueLevel(false, random(0.05, config.glitch_max));
+        queueLevel(true, 2);
+        ++counters.glitches;
+    }
+    queueLevel(false, std::uniform_int_distribution<int>(config.break_min, config.break_max)(rng));
+    queueLevel(true, 1); //break delimiter
+    queueByte(frame.bytes[0]);
+    queueByte(frame.bytes[1]);
+
+    //slave: the response with its own clock error
+    bit_ns = nominal_ns * (1 + random(-config.drift, config.drift));
+    queueLevel(true, config.response_space);
+    for (uint8_t i = 2; i < frame.count; ++i)
+    {
+        bool framing_error = random(0, 1) < config.framing_rate;
+        queueByte(frame.bytes[i], framing_error);
+        counters.framing_errors += framing_error;
+    }
+
+    bit_ns = nominal_ns;
+    queueLevel(true, config.interframe_space);
+    bus_time = time;
+    expected.push_back(frame);
+    ++counters.sent;
+    return bus_time;
+}
+
+void lin_generator::frameReported(const uint8_t *bytes, uint8_t count)
+{
+    for (size_t i = 0; i < expected.size() && i < GEN_MATCH_WINDOW; ++i)
+    {
+        const generated_frame &frame = expected[i];
+        if (frame.count == count && !memcmp(frame.bytes, bytes, count))
+        {
+            //everything sent before this frame was not reported
+            for (size_t j = 0; j < i; ++j)
+                if (!expected[j].truncated)
+                    ++counters.lost;
+            if (frame.truncated)
+                ++counters.partial;
+            else
+                ++counters.decoded;
+            expected.erase(expected.begin(), expected.begin() + i + 1);
+            return;
+        }
+    }
+    //reported, but not as it was sent
+    ++counters.corrupted;
+    if (!expected.empty())
+        expected.pop_front();
+}
+
+void lin_generator::finish()
+{
+    for (const generated_frame &frame : expected)
+        if (!frame.truncated)
+            ++counters.lost;
+    expected.clear();
+}
+#endif
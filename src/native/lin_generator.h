@@ -0,0 +1,101 @@
+#pragma once
+//synthetic LIN bus for the host build
+//Turns a schedule table into the edges the RX interrupt of the Due would see: breaks of varying
+//length, sync, PID, response and checksum, with baud drift, edge jitter, glitches and truncated responses.
+//Every generated frame is remembered, so frames reported by the sniffer can be checked against them.
+#include <stdint.h>
+#include <deque>
+#include <random>
+#include <vector>
+
+#define GEN_MAX_FRAME_BYTES 11 //sync + pid + 8 bytes + chk
+#define GEN_DIAG_NAD 0x0A        //node address of the diagnostic messages
+#define GEN_DIAG_MAX_LENGTH 150  //diagnostic messages are 1 to this many bytes long
+
+struct generator_slot
+{
+    uint8_t id;
+    uint8_t length; //number of data bytes
+};
+
+struct generator_config
+{
+    long baud = 19200;
+    uint8_t break_min = 13;      //length of the break field in bits, chosen randomly for every frame
+    uint8_t break_max = 13;
+    uint8_t response_space = 1;  //bits between the header and the response
+    uint8_t interframe_space = 0; //bits between frames, 0 is 100% bus load
+    double drift = 0;            //maximum relative baud error of the master and of every slave response
+    double jitter = 0;           //maximum random shift of every edge, in bits (at most 0.25)
+    double glitch_rate = 0;      //probability of a glitch before a frame
+    double glitch_max = 0.4;     //maximum length of a glitch in bits (shorter than the minimum break)
+    double truncate_rate = 0;    //probability of a response being cut short (or missing)
+    double framing_rate = 0;     //probability of a response byte with a low stop bit
+    uint32_t seed = 1;
+    uint8_t channel = 1;         //bus the frames are put on
+};
+
+//a frame as it was put on the bus
+struct generated_frame
+{
+    uint8_t bytes[GEN_MAX_FRAME_BYTES]; //sync + pid + data + chk, as the sniffer should see them
+    uint8_t count;
+    bool truncated;
+};
+
+struct generator_stats
+{
+    uint64_t sent;      //frames put on the bus
+    uint64_t truncated; //of those with a truncated or missing response
+    uint64_t glitches;  //glitches put on the bus
+    uint64_t framing_errors; //response bytes sent with a low stop bit
+    uint64_t decoded;   //complete frames reported exactly as sent
+    uint64_t partial;   //truncated frames reported with the bytes that were sent
+    uint64_t corrupted; //frames reported with different bytes
+    uint64_t lost;      //complete frames that were never reported
+};
+
+class lin_generator
+{
+public:
+    lin_generator(const generator_config &config, const std::vector<generator_slot> &schedule);
+
+    //queues the next frame of the schedule at the bus time and returns the time after it
+    uint64_t queueFrame();
+    uint64_t busTime() const { return bus_time; }
+    void setBusTime(uint64_t time) { bus_time = time; }
+
+    //checks a frame reported by the sniffer against the frames sent
+    void frameReported(const uint8_t *bytes, uint8_t count);
+    //everything not reported until now is lost
+    void finish();
+    const generator_stats &stats() const { return counters; }
+
+    static uint8_t protectedId(uint8_t id);
+    static uint8_t checksum(const uint8_t *data, uint8_t length, uint8_t pid);
+
+private:
+    double random(double low, double high);
+    void queueLevel(bool new_level, double bits);
+    void queueByte(uint8_t value, bool framing_error = false);
+    void diagnosticData(uint8_t direction, uint8_t *data);
+
+    generator_config config;
+    std::vector<generator_slot> schedule;
+    size_t slot = 0;
+    uint64_t frame_number = 0;
+    //diagnostic messages, index 0 - master requests, 1 - slave responses
+    uint32_t diag_messages[2] = {};
+    uint16_t diag_sent[2] = {}; //bytes of the message being sent
+    uint8_t diag_sequence[2] = {};
+    std::mt19937 rng;
+
+    uint64_t bus_time = 0; //end of the last queued frame
+    double time = 0;       //position of the waveform being generated, in ns
+    double bit_ns = 0;     //bit time of the node sending at the moment
+    bool level = true;
+    uint64_t last_edge = 0;
+
+    std::deque<generated_frame> expected; //frames sent, not reported yet
+    generator_stats counters = {0, 0, 0, 0, 0, 0, 0, 0};
+};
@@ -0,0 +1,384 @@
+#ifndef ARDUINO
+#include "native_hal.h"
+#include <stdio.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_COUNTER 1
+#endif
+#include <deque>
+#include <vector>
+
+#define SIM_RX_BUFFER_SIZE 128 //same as the receive buffer of the Due's serial ports
+#define SIM_TX_BUFFER_SIZE 128 //same as the transmit buffer of the Due's serial ports
+#define SIM_STORAGE_SIZE 16384
+#define SIM_FLASH_PAGE 256
+#define SIM_FLASH_PAGE_NS 4000000 //erase and write of a flash page, the loop waits for it
+
+namespace
+{
+    struct edge
+    {
+        uint64_t time;
+        bool level;
+    };
+
+    //simulated USART, samples the line in the middle of every bit like the Due
+    struct sim_uart
+    {
+        bool enabled = false;
+        uint64_t bit_ns = 0;
+        bool receiving = false;
+        bool armed = true;    //a new start bit can only follow a high level
+        uint64_t start = 0;   //falling edge of the start bit
+        uint8_t next_bit = 0; //next of the 10 samples (start, 8 data, stop) to take
+        bool bits[10];
+        uint8_t buffer[SIM_RX_BUFFER_SIZE];
+        uint16_t head = 0;
+        uint16_t tail = 0;
+    };
+
+    //one LIN bus with the USART and RX pin it is connected to
+    struct sim_bus
+    {
+        bool line_level = true; //the LIN bus is recessive (high) when idle
+        std::deque<edge> edges;
+        uint64_t last_queued_edge = 0;
+        void (*rx_handler)() = nullptr;
+        sim_uart uart;
+        sim::uart_stats counters = {0, 0, 0, 0};
+    };
+
+    uint64_t clock_ns = 0;
+    sim_bus buses[LIN_CHANNELS];
+    void (*frame_handler)(uint8_t, const uint8_t *, uint8_t) = nullptr;
+
+    //channels are numbered from 1 like the serial ports
+    sim_bus &bus(uint8_t channel) { return buses[channel - 1]; }
+
+    std::string host_input;
+    size_t host_input_pos = 0;
+    bool echo = false;
+    uint64_t output_bytes = 0;
+
+    //host serial port transmitter, sends one byte per 10 bit times
+    uint64_t tx_byte_ns = 0; //0 until begin() - everything is sent at once
+    uint64_t tx_busy_until = 0;
+    uint64_t tx_stall_ns = 0;
+
+    uint32_t cycles_per_us = 1000;
+
+    uint64_t realTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t txPending()
+    {
+        if (!tx_byte_ns || tx_busy_until <= clock_ns)
+            return 0;
+        return (tx_busy_until - clock_ns + tx_byte_ns - 1) / tx_byte_ns;
+    }
+
+    std::vector<uint8_t> storage(SIM_STORAGE_SIZE, 0xFF); //erased flash
+
+    uint64_t sampleTime(const sim_uart &uart, uint8_t bit) { return uart.start + uart.bit_ns * bit + uart.bit_ns / 2; }
+
+    //takes all samples up to time with the current line level
+    void sampleUntil(sim_bus &b, uint64_t time)
+    {
+        sim_uart &uart = b.uart;
+        while (uart.next_bit < 10 && sampleTime(uart, uart.next_bit) < time)
+            uart.bits[uart.next_bit++] = b.line_level;
+    }
+
+    //the start bit is checked in its middle, the byte is complete in the middle of the stop bit
+    uint64_t uartEventTime(const sim_uart &uart)
+    {
+        if (!uart.receiving)
+            return UINT64_MAX;
+        return sampleTime(uart, uart.next_bit == 0 ? 0 : 9);
+    }
+
+    void finishByte(sim_bus &b)
+    {
+        sim_uart &uart = b.uart;
+        if (uart.next_bit == 0)
+        {
+            sampleUntil(b, sampleTime(uart, 0) + 1);
+            uart.receiving = !uart.bits[0]; //a start bit shorter than half a bit is a glitch
+            return;
+        }
+        sampleUntil(b, sampleTime(uart, 9) + 1);
+        uart.receiving = false;
+        uint8_t value = 0;
+        for (int i = 0; i < 8; ++i)
+            value |= uart.bits[i + 1] << i;
+        if (!uart.bits[9])
+        {
+            //framing error: the byte is still stored, then the receiver waits for the line to go high
+            ++b.counters.framing_errors;
+            uart.armed = b.line_level;
+        }
+        uint16_t next = (uart.head + 1) % SIM_RX_BUFFER_SIZE;
+        if (next == uart.tail)
+        {
+            ++b.counters.overruns;
+            return;
+        }
+        uart.buffer[uart.head] = value;
+        uart.head = next;
+        ++b.counters.bytes;
+    }
+
+    void applyEdge(sim_bus &b, const edge &e)
+    {
+        sim_uart &uart = b.uart;
+        if (uart.receiving)
+            sampleUntil(b, e.time);
+        b.line_level = e.level;
+        if (uart.enabled)
+        {
+            if (b.line_level)
+                uart.armed = true;
+            else if (!uart.receiving && uart.armed)
+            {
+                uart.receiving = true;
+                uart.start = e.time;
+                uart.next_bit = 0;
+            }
+        }
+        if (b.rx_handler)
+        {
+            ++b.counters.interrupts;
+            b.rx_handler();
+        }
+    }
+}
+
+HostPort HostSerial;
+
+void HostPort::begin(unsigned long baud) { tx_byte_ns = 10000000000ULL / baud; }
+
+int HostPort::available() { return host_input.size() - host_input_pos; }
+
+int HostPort::read()
+{
+    if (host_input_pos >= host_input.size())
+        return -1;
+    return (uint8_t)host_input[host_input_pos++];
+}
+
+void HostPort::flush() { fflush(stdout); }
+
+int HostPort::availableForWrite() { return SIM_TX_BUFFER_SIZE - txPending(); }
+
+//a write that does not fit into the transmit buffer would block the sniffer until it does
+size_t HostPort::write(const uint8_t *buffer, size_t size)
+{
+    uint64_t pending = txPending();
+    if (pending + size > SIM_TX_BUFFER_SIZE)
+    {
+        tx_stall_ns += (pending + size - SIM_TX_BUFFER_SIZE) * tx_byte_ns;
+        if (waiting)
+            waiting();
+    }
+    tx_busy_until = (tx_busy_until > clock_ns ? tx_busy_until : clock_ns) + size * tx_byte_ns;
+    output_bytes += size;
+    if (echo)
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+size_t HostPort::print(long value, int base)
+{
+    if (value < 0)
+        return print('-') + print((unsigned long)-value, base);
+    return print((unsigned long)value, base);
+}
+
+size_t HostPort::print(unsigned long value, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", value);
+    return write(buf);
+}
+
+size_t HostPort::print(double value, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return write(buf);
+}
+
+namespace hal
+{
+    void timestampInit() {}
+    unsigned long timestamp() { return (unsigned long)(uint32_t)(clock_ns / 1000); } //wraps like the Due's timer
+
+    void cyclesInit()
+    {
+#ifdef CYCLE_COUNTER
+        uint64_t start = realTime();
+        uint64_t start_cycles = __rdtsc();
+        while (realTime() - start < 10000000)
+            ;
+        cycles_per_us = (__rdtsc() - start_cycles) * 1000 / (realTime() - start);
+        if (!cycles_per_us)
+            cycles_per_us = 1;
+#endif
+    }
+    uint32_t cycles()
+    {
+#ifdef CYCLE_COUNTER
+        return __rdtsc();
+#else
+        return realTime();
+#endif
+    }
+    uint32_t cyclesPerMicrosecond() { return cycles_per_us; }
+
+    bool rxLevel(uint8_t channel) { return bus(channel).line_level; }
+    void attachRxEdge(uint8_t channel, void (*handler)()) { bus(channel).rx_handler = handler; }
+    void detachRxEdge(uint8_t channel) { bus(channel).rx_handler = nullptr; }
+
+    void linBegin(uint8_t channel, long baud)
+    {
+        sim_uart &uart = bus(channel).uart;
+        uart.enabled = true;
+        uart.bit_ns = 1000000000ULL / baud;
+        uart.receiving = false;
+        uart.armed = bus(channel).line_level;
+        uart.head = uart.tail = 0;
+    }
+    void linSetBaud(uint8_t channel, long baud) { bus(channel).uart.bit_ns = 1000000000ULL / baud; }
+
+    void linEnd(uint8_t channel)
+    {
+        sim_uart &uart = bus(channel).uart;
+        uart.enabled = false;
+        uart.receiving = false;
+    }
+    int linAvailable(uint8_t channel)
+    {
+        const sim_uart &uart = bus(channel).uart;
+        return (uart.head - uart.tail + SIM_RX_BUFFER_SIZE) % SIM_RX_BUFFER_SIZE;
+    }
+    uint8_t linRead(uint8_t channel)
+    {
+        sim_uart &uart = bus(channel).uart;
+        if (uart.head == uart.tail)
+            return 0xFF;
+        uint8_t value = uart.buffer[uart.tail];
+        uart.tail = (uart.tail + 1) % SIM_RX_BUFFER_SIZE;
+        return value;
+    }
+
+    uint8_t storageRead(uint32_t address) { return address < storage.size() ? storage[address] : 0xFF; }
+    bool storageWrite(uint32_t address, uint8_t *data, uint32_t length)
+    {
+        if (address + length > storage.size())
+            return false;
+        memcpy(storage.data() + address, data, length);
+        //the interrupts go on while the flash is busy
+        uint32_t pages = (address + length - 1) / SIM_FLASH_PAGE - address / SIM_FLASH_PAGE + 1;
+        sim::advance(clock_ns + pages * SIM_FLASH_PAGE_NS);
+        return true;
+    }
+
+    void frameReceived(uint8_t channel, const uint8_t *bytes, uint8_t count)
+    {
+        if (frame_handler)
+            frame_handler(channel, bytes, count);
+    }
+};
+
+namespace sim
+{
+    uint64_t now() { return clock_ns; }
+
+    void queueEdge(uint8_t channel, uint64_t time, bool level)
+    {
+        bus(channel).edges.push_back({time, level});
+        bus(channel).last_queued_edge = time;
+    }
+
+    uint64_t lastQueuedEdge(uint8_t channel) { return bus(channel).last_queued_edge; }
+
+    size_t queuedEdges()
+    {
+        size_t count = 0;
+        for (const sim_bus &b : buses)
+            count += b.edges.size();
+        return count;
+    }
+
+    //the events of all buses are processed in time order, so the interrupts interleave like on the Due
+    void advance(uint64_t time)
+    {
+        while (true)
+        {
+            sim_bus *next_bus = nullptr;
+            uint64_t next = UINT64_MAX;
+            bool next_is_byte = false;
+            for (sim_bus &b : buses)
+            {
+                uint64_t next_byte = uartEventTime(b.uart);
+                uint64_t next_edge = b.edges.empty() ? UINT64_MAX : b.edges.front().time;
+                if (next_byte < next || (next_byte != UINT64_MAX && next_byte == next && !next_is_byte))
+                {
+                    next = next_byte;
+                    next_bus = &b;
+                    next_is_byte = true;
+                }
+                if (next_edge < next)
+                {
+                    next = next_edge;
+                    next_bus = &b;
+                    next_is_byte = false;
+                }
+            }
+            if (!next_bus || next > time)
+                break;
+            clock_ns = next;
+            if (next_is_byte)
+                finishByte(*next_bus);
+            else
+            {
+                edge e = next_bus->edges.front();
+                next_bus->edges.pop_front();
+                applyEdge(*next_bus, e);
+            }
+        }
+        clock_ns = time;
+    }
+
+    void onFrame(void (*handler)(uint8_t, const uint8_t *, uint8_t)) { frame_handler = handler; }
+
+    void hostInput(const char *text)
+    {
+        host_input.erase(0, host_input_pos);
+        host_input_pos = 0;
+        host_input += text;
+    }
+
+    void echoOutput(bool enable) { echo = enable; }
+
+    uint64_t outputBytes() { return output_bytes; }
+
+    uint64_t outputStall() { return tx_stall_ns; }
+
+    uart_stats uartStats()
+    {
+        uart_stats total = {0, 0, 0, 0};
+        for (const sim_bus &b : buses)
+        {
+            total.bytes += b.counters.bytes;
+            total.framing_errors += b.counters.framing_errors;
+            total.overruns += b.counters.overruns;
+            total.interrupts += b.counters.interrupts;
+        }
+        return total;
+    }
+};
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+//host side implementation of the hardware abstraction layer (env:native)
+//The LIN buses are simulated: edges are scheduled with sim::queueEdge(), the simulated USART of the
+//channel samples them like the Due does and the attached RX interrupt is called for every edge.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+
+//the few Arduino core definitions the sniffer uses
+typedef uint8_t byte;
+#define HEX 16
+#define DEC 10
+inline bool isHexadecimalDigit(int c) { return isxdigit(c); }
+
+#define LIN_CHANNELS 3 //simulated LIN ports, like the Due's Serial1..3
+
+//output sink and command source, stands in for the Due's Serial
+class HostPort
+{
+public:
+    void (*waiting)() = nullptr; //called once by a write that would wait for room in the transmit buffer
+
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    void flush();
+    int availableForWrite();
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(double value, int digits = 2);
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+    template <typename T>
+    size_t println(const T &value, int format) { return print(value, format) + println(); }
+};
+extern HostPort HostSerial;
+
+namespace hal
+{
+    //time source, microseconds
+    void timestampInit();
+    unsigned long timestamp();
+
+    //profiling: the time stamp counter on x86 (its rate is measured by cyclesInit()), nanoseconds elsewhere
+    void cyclesInit();
+    uint32_t cycles();
+    uint32_t cyclesPerMicrosecond();
+
+    //RX edge source
+    bool rxLevel(uint8_t channel);
+    void attachRxEdge(uint8_t channel, void (*handler)());
+    void detachRxEdge(uint8_t channel);
+
+    //LIN byte source
+    void linBegin(uint8_t channel, long baud);
+    void linEnd(uint8_t channel);
+    void linSetBaud(uint8_t channel, long baud);
+    int linAvailable(uint8_t channel);
+    uint8_t linRead(uint8_t channel);
+
+    //the same for one port, as the sniffer uses them
+    template <uint8_t CHANNEL>
+    inline void rxInit() {}
+    template <uint8_t CHANNEL>
+    inline bool rxLevel() { return rxLevel(CHANNEL); }
+    template <uint8_t CHANNEL>
+    inline void attachRxEdge(void (*handler)()) { attachRxEdge(CHANNEL, handler); }
+    template <uint8_t CHANNEL>
+    inline void detachRxEdge() { detachRxEdge(CHANNEL); }
+    template <uint8_t CHANNEL>
+    inline void linBegin(long baud) { linBegin(CHANNEL, baud); }
+    template <uint8_t CHANNEL>
+    inline void linEnd() { linEnd(CHANNEL); }
+    template <uint8_t CHANNEL>
+    inline void linSetBaud(long baud) { linSetBaud(CHANNEL, baud); }
+    template <uint8_t CHANNEL>
+    inline int linAvailable() { return linAvailable(CHANNEL); }
+    template <uint8_t CHANNEL>
+    inline uint8_t linRead() { return linRead(CHANNEL); }
+
+    //persistent storage
+    uint8_t storageRead(uint32_t address);
+    bool storageWrite(uint32_t address, uint8_t *data, uint32_t length);
+
+    //probe for the host build, called with every frame (sync + pid + data + chk) passed on for reporting
+    void frameReceived(uint8_t channel, const uint8_t *bytes, uint8_t count);
+};
+
+//control of the simulation, used by the host program
+namespace sim
+{
+    //all simulation times are in nanoseconds
+    uint64_t now();
+    //schedules the bus of the channel to change to level at time (must not be earlier than its last queued edge)
+    void queueEdge(uint8_t channel, uint64_t time, bool level);
+    uint64_t lastQueuedEdge(uint8_t channel);
+    size_t queuedEdges(); //of all buses
+    //moves the clock forward, calling the RX interrupts and feeding the USARTs on the way
+    void advance(uint64_t time);
+    //called with every frame the sniffer passes on for reporting
+    void onFrame(void (*handler)(uint8_t channel, const uint8_t *bytes, uint8_t count));
+    //text typed into the host serial port
+    void hostInput(const char *text);
+    //whether output is printed to stdout, it is always counted
+    void echoOutput(bool echo);
+    uint64_t outputBytes();
+    //how long writes to the host serial port would have blocked because its transmit buffer was full
+    uint64_t outputStall();
+
+    //USART statistics, summed over all buses
+    struct uart_stats
+    {
+        uint64_t bytes;          //bytes delivered to the receive buffer
+        uint64_t framing_errors; //bytes with a low stop bit
+        uint64_t overruns;       //bytes lost because the receive buffer was full
+        uint64_t interrupts;     //calls of the RX edge interrupt
+    };
+    uart_stats uartStats();
+};
@@ -0,0 +1,238 @@
+#ifndef ARDUINO
+//host program for env:native
+//Runs setup() and loop() of the sniffer against synthetic LIN buses, checks every reported frame
+//against what was sent and reports frame loss and how much CPU time the sniffer needed per frame.
+#include "native_hal.h"
+#include "lin_generator.h"
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_COUNTER 1
+#endif
+
+void setup();
+void loop();
+
+namespace
+{
+    const char usage[] =
+        "usage: %s [options]\n"
+        "  -n frames    number of frames to send (100000)\n"
+        "  -b baud      LIN baudrate (19200)\n"
+        "  -c command   command sent to the sniffer before the start, can be repeated\n"
+        "  -e command   command sent to the sniffer after the last frame, can be repeated\n"
+        "  -v           print the output of the sniffer\n"
+        "  -s seed      seed of the random generator (1)\n"
+        "  -k min max   break length in bits (13 13)\n"
+        "  -i bits      inter frame space, 0 is 100%% bus load (0)\n"
+        "  -d percent   maximum baud drift of the master and the slaves (0)\n"
+        "  -j bits      maximum edge jitter (0)\n"
+        "  -g rate      probability of a glitch before a frame (0)\n"
+        "  -G bits      maximum glitch length (0.4)\n"
+        "  -t rate      probability of a truncated response (0)\n"
+        "  -f rate      probability of a response byte with a low stop bit (0)\n"
+        "  -B buses     number of buses sending at the same time, 1 to 3 (1)\n";
+
+    //a schedule table with every LIN frame length class and a diagnostic frame
+    const std::vector<generator_slot> schedule = {{0x10, 2}, {0x21, 4}, {0x32, 8}, {0x05, 1}, {0x3C, 8}, {0x2A, 4}, {0x11, 2}, {0x3D, 8}};
+
+    lin_generator *generators[LIN_CHANNELS] = {};
+
+    //CPU cycles, 0 where no cycle counter is available
+    uint64_t cycles()
+    {
+#ifdef CYCLE_COUNTER
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    void frameReported(uint8_t channel, const uint8_t *bytes, uint8_t count)
+    {
+        if (channel >= 1 && channel <= LIN_CHANNELS && generators[channel - 1])
+            generators[channel - 1]->frameReported(bytes, count);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long frames = 100000;
+    int bus_count = 1;
+    generator_config config;
+    std::vector<const char *> commands;
+    std::vector<const char *> end_commands;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool arg = i + 1 < argc;
+        if (!strcmp(argv[i], "-n") && arg)
+            frames = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-b") && arg)
+            config.baud = strtol(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-c") && arg)
+            commands.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "-e") && arg)
+            end_commands.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "-v"))
+            sim::echoOutput(true);
+        else if (!strcmp(argv[i], "-s") && arg)
+            config.seed = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-k") && i + 2 < argc)
+        {
+            config.break_min = atoi(argv[++i]);
+            config.break_max = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-i") && arg)
+            config.interframe_space = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && arg)
+            config.drift = atof(argv[++i]) / 100;
+        else if (!strcmp(argv[i], "-j") && arg)
+            config.jitter = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-g") && arg)
+            config.glitch_rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-G") && arg)
+            config.glitch_max = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && arg)
+            config.truncate_rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-f") && arg)
+            config.framing_rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-B") && arg)
+            bus_count = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+    }
+    if (config.break_min > config.break_max || config.baud <= 0 || bus_count < 1 || bus_count > LIN_CHANNELS)
+    {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    //every bus sends its own frame sequence, each has to reach the given number of frames
+    std::vector<lin_generator *> buses;
+    for (int channel = 1; channel <= bus_count; ++channel)
+    {
+        generator_config bus_config = config;
+        bus_config.channel = channel;
+        bus_config.seed = config.seed + channel - 1;
+        buses.push_back(new lin_generator(bus_config, schedule));
+        generators[channel - 1] = buses.back();
+    }
+    sim::onFrame(frameReported);
+
+    setup();
+    char line[64];
+    snprintf(line, sizeof(line), "baud %ld\n", config.baud);
+    sim::hostInput(line);
+    for (const char *command : commands)
+    {
+        sim::hostInput(command);
+        sim::hostInput("\n");
+    }
+    sim::hostInput("start\n");
+
+    const uint64_t bit_ns = 1000000000ULL / config.baud;
+    const uint64_t tick = bit_ns; //the simulated loop runs once per bit time
+    for (lin_generator *bus : buses)
+        bus->setBusTime(1000000); //let the commands be processed first
+
+    typedef std::chrono::steady_clock timer;
+    timer::duration in_loop(0);
+    unsigned long loop_calls = 0;
+    uint64_t loop_cycles = 0;
+    timer::time_point start = timer::now();
+    uint64_t bus_time = 0;
+    while (true)
+    {
+        //keep a few frames ahead of the clock
+        bool sending = false;
+        for (lin_generator *bus : buses)
+        {
+            while (bus->stats().sent < frames && bus->busTime() < sim::now() + 200 * bit_ns)
+                bus->queueFrame();
+            sending |= bus->stats().sent < frames;
+            if (bus->busTime() > bus_time)
+                bus_time = bus->busTime();
+        }
+        if (!sending && !sim::queuedEdges() && sim::now() >= bus_time + 200 * bit_ns)
+            break;
+        sim::advance(sim::now() + tick);
+        timer::time_point before = timer::now();
+        uint64_t cycles_before = cycles();
+        loop();
+        loop_cycles += cycles() - cycles_before;
+        in_loop += timer::now() - before;
+        ++loop_calls;
+    }
+    timer::duration total = timer::now() - start;
+    for (lin_generator *bus : buses)
+        bus->finish();
+
+    //queries of what the sniffer measured, not part of the timing
+    for (const char *command : end_commands)
+    {
+        sim::hostInput(command);
+        sim::hostInput("\n");
+        for (int i = 0; i < 10000; ++i)
+        {
+            sim::advance(sim::now() + tick);
+            loop();
+        }
+    }
+
+    //the timer itself costs something, measure it and take it out of the loop time
+    for (unsigned long i = 0; i < loop_calls; ++i)
+    {
+        timer::time_point before = timer::now();
+        uint64_t cycles_before = cycles();
+        loop_cycles -= cycles() - cycles_before;
+        in_loop -= timer::now() - before;
+    }
+
+    typedef std::chrono::duration<double, std::nano> ns;
+    generator_stats gen = {};
+    for (lin_generator *bus : buses)
+    {
+        const generator_stats &bus_stats = bus->stats();
+        gen.sent += bus_stats.sent;
+        gen.truncated += bus_stats.truncated;
+        gen.glitches += bus_stats.glitches;
+        gen.framing_errors += bus_stats.framing_errors;
+        gen.decoded += bus_stats.decoded;
+        gen.partial += bus_stats.partial;
+        gen.lost += bus_stats.lost;
+        gen.corrupted += bus_stats.corrupted;
+    }
+    sim::uart_stats uart = sim::uartStats();
+    double sent = gen.sent ? gen.sent : 1;
+    double complete = gen.sent - gen.truncated;
+    fprintf(stderr, "frames sent:        %llu (%llu truncated, %llu glitches, %llu framing errors)\n",
+            (unsigned long long)gen.sent, (unsigned long long)gen.truncated, (unsigned long long)gen.glitches, (unsigned long long)gen.framing_errors);
+    fprintf(stderr, "frames decoded:     %llu complete, %llu partial\n", (unsigned long long)gen.decoded, (unsigned long long)gen.partial);
+    fprintf(stderr, "frames lost:        %llu (%.4f%%)\n", (unsigned long long)gen.lost, complete > 0 ? 100.0 * gen.lost / complete : 0.0);
+    fprintf(stderr, "frames corrupted:   %llu\n", (unsigned long long)gen.corrupted);
+    if (buses.size() > 1)
+        for (size_t i = 0; i < buses.size(); ++i)
+            fprintf(stderr, "  bus %u:            %llu lost, %llu corrupted\n", (unsigned)i + 1,
+                    (unsigned long long)buses[i]->stats().lost, (unsigned long long)buses[i]->stats().corrupted);
+    fprintf(stderr, "simulated time:     %.3f s\n", sim::now() / 1e9);
+    fprintf(stderr, "bytes received:     %llu (%llu framing errors, %llu overruns)\n",
+            (unsigned long long)uart.bytes, (unsigned long long)uart.framing_errors, (unsigned long long)uart.overruns);
+    fprintf(stderr, "RX interrupts:      %llu\n", (unsigned long long)uart.interrupts);
+    fprintf(stderr, "output bytes:       %llu (blocked for %.3f s)\n", (unsigned long long)sim::outputBytes(), sim::outputStall() / 1e9);
+    fprintf(stderr, "loop() calls:       %lu\n", loop_calls);
+    fprintf(stderr, "loop() time/frame:  %.1f ns\n", ns(in_loop).count() / sent);
+    if (cycles())
+        fprintf(stderr, "loop() cycles/frame: %.0f\n", loop_cycles / sent);
+    fprintf(stderr, "total time/frame:   %.1f ns\n", ns(total).count() / sent);
+    fprintf(stderr, "decode throughput:  %.0f frames/s (%.1fx real time)\n",
+            sent / (ns(total).count() / 1e9), (sim::now() / 1e9) / (ns(total).count() / 1e9));
+    for (lin_generator *bus : buses)
+        delete bus;
+    return 0;
+}
+#endif
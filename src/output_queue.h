@@ -0,0 +1,134 @@
+#pragma once
+#include "LIN_handler.h"
+
+#define OUTPUT_QUEUE_SIZE 64 //number of reports waiting for the host serial port
+
+enum report_kind_t
+{
+    report_new_loop = 0,
+    report_new,
+    report_changed,
+    report_unchanged,
+    report_error,     //a frame with a parity or checksum error
+    report_suppressed //frames of an id its limit held back
+};
+
+//what to give up when the queue is full
+enum overflow_policy_t
+{
+    overflow_oldest = 0, //drop the oldest report
+    overflow_unchanged,  //drop the oldest unchanged frame, the oldest report if there is none
+    overflow_coalesce    //merge the frame with a waiting report of the same id and bus, drop the oldest if there is none
+};
+
+//a decoded frame (or new loop marker) waiting to be reported
+struct report_t
+{
+    report_kind_t kind;
+    uint8_t loop_frames; //report_new_loop: number of frames in the finished loop
+    unsigned long time;  //report_new_loop: time of the marker
+    data_frame frame;     //report_new_loop: only the channel is set
+    data_frame old_frame; //report_changed: the frame it is compared to
+    uint32_t suppressed;  //report_suppressed: frames since the last report of the id, time is the last of them
+};
+
+//bounded FIFO between the LIN reception and the host serial port.
+//Both sides run in loop(), so removing from the middle is allowed.
+class output_queue
+{
+public:
+    void push(const report_t &report, overflow_policy_t policy)
+    {
+        if (count == OUTPUT_QUEUE_SIZE)
+        {
+            if (policy == overflow_coalesce && coalesce(report))
+            {
+                ++coalesced;
+                return;
+            }
+            int victim = policy == overflow_unchanged ? findUnchanged() : -1;
+            remove(victim >= 0 ? victim : 0);
+            ++dropped;
+        }
+        at(count) = report;
+        ++count;
+        if (count > high_water)
+            high_water = count;
+    }
+
+    bool pop(report_t &report)
+    {
+        if (count == 0)
+            return false;
+        report = at(0);
+        head = (head + 1) % OUTPUT_QUEUE_SIZE;
+        --count;
+        return true;
+    }
+
+    bool empty() const { return count == 0; }
+    uint16_t size() const { return count; }
+    void clear() { count = 0; }
+
+    uint32_t dropped = 0;    //reports thrown away because the queue was full
+    uint32_t coalesced = 0;  //frames merged into a waiting report of the same id and bus
+    uint16_t high_water = 0; //the most reports that were waiting at once
+
+private:
+    report_t &at(uint16_t index) { return reports[(head + index) % OUTPUT_QUEUE_SIZE]; }
+
+    //index (from the oldest) of the oldest unchanged frame, -1 if there is none
+    int findUnchanged()
+    {
+        for (uint16_t i = 0; i < count; ++i)
+            if (at(i).kind == report_unchanged)
+                return i;
+        return -1;
+    }
+
+    //index (from the oldest) of the waiting frame with the id on the bus, -1 if there is none
+    int findId(uint8_t channel, uint8_t id)
+    {
+        for (uint16_t i = 0; i < count; ++i)
+            if (at(i).kind != report_new_loop && at(i).kind != report_error && at(i).kind != report_suppressed && at(i).frame.id == id && at(i).frame.channel == channel)
+                return i;
+        return -1;
+    }
+
+    void remove(uint16_t index)
+    {
+        if (index == 0)
+        {
+            head = (head + 1) % OUTPUT_QUEUE_SIZE;
+            --count;
+            return;
+        }
+        for (uint16_t i = index; i + 1 < count; ++i)
+            at(i) = at(i + 1);
+        --count;
+    }
+
+    //the waiting report of the same id shows the newest contents, compared to what was reported before it
+    bool coalesce(const report_t &report)
+    {
+        if (report.kind == report_new_loop || report.kind == report_error || report.kind == report_suppressed)
+            return false;
+        int index = findId(report.frame.channel, report.frame.id);
+        if (index < 0)
+            return false;
+        report_t &waiting = at(index);
+        if (waiting.kind == report_unchanged)
+        {
+            waiting.kind = report.kind;
+            waiting.old_frame = report.old_frame;
+        }
+        else if (waiting.kind == report_changed && report.kind == report_new)
+            waiting.kind = report_new;
+        waiting.frame = report.frame;
+        return true;
+    }
+
+    report_t reports[OUTPUT_QUEUE_SIZE];
+    uint16_t head = 0;
+    uint16_t count = 0;
+};
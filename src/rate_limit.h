@@ -0,0 +1,129 @@
+#pragma once
+#include "LIN_handler.h"
+
+#define LIMIT_MAX_VALUE 1000          //largest reports per second, K and change threshold
+#define LIMIT_SUMMARY_PERIOD 1000000UL //us frames stay suppressed before they are summarized without a report of their id
+
+enum limit_kind_t
+{
+    limit_off = 0,
+    limit_rate,  //at most value reports per second
+    limit_every, //every value-th frame
+    limit_delta  //a byte of mask differs by value or more from the last report (or the length changed)
+};
+
+//the output limit of an id, applies to every bus. Saved with the settings
+struct id_limit
+{
+    uint8_t kind; //limit_kind_t
+    uint8_t mask; //limit_delta: bit n - data byte n is compared
+    uint16_t value;
+};
+
+//counts the frames the limits hold back, per bus and id. A report of the id takes the count with it, frames that
+//stay suppressed are summarized after LIMIT_SUMMARY_PERIOD
+class rate_limiter
+{
+public:
+    void clear()
+    {
+        memset(states, 0, sizeof(states));
+        memset(pending, 0, sizeof(pending));
+    }
+
+    //whether the frame is reported, a frame that is not is counted
+    bool pass(const id_limit &limit, const data_frame &frame)
+    {
+        limit_state &s = states[frame.channel - 1][frame.id];
+        bool passes = true;
+        switch (limit.kind)
+        {
+        case limit_rate:
+            if (!s.started || frame.time - s.window >= 1000000UL)
+            {
+                s.window = frame.time;
+                s.passed = 0;
+            }
+            passes = s.passed < limit.value;
+            if (passes)
+                ++s.passed;
+            break;
+        case limit_every:
+            passes = !s.started || ++s.frames >= limit.value;
+            if (passes)
+                s.frames = 0;
+            break;
+        case limit_delta:
+            passes = !s.started || frame.data_count != s.data_count || differs(limit, frame.data, s.data);
+            if (passes)
+            {
+                s.data_count = frame.data_count;
+                memcpy(s.data, frame.data, sizeof(s.data));
+            }
+            break;
+        }
+        s.started = true;
+        if (passes)
+            return true;
+        if (!s.suppressed)
+        {
+            s.since = frame.time;
+            pending[frame.channel - 1] |= 1ULL << frame.id;
+        }
+        ++s.suppressed;
+        s.last = frame.time;
+        return false;
+    }
+
+    //frames of the id held back since its last report (or summary), 0 if none. The count starts over
+    uint32_t take(uint8_t channel, uint8_t id, unsigned long &last)
+    {
+        limit_state &s = states[channel - 1][id];
+        uint32_t suppressed = s.suppressed;
+        last = s.last;
+        s.suppressed = 0;
+        pending[channel - 1] &= ~(1ULL << id);
+        return suppressed;
+    }
+
+    //an id whose frames were held back for LIMIT_SUMMARY_PERIOD, false if there is none
+    bool due(unsigned long now, uint8_t &channel, uint8_t &id)
+    {
+        for (uint8_t ch = 0; ch < LIN_CHANNELS; ++ch)
+            for (uint64_t bits = pending[ch]; bits; bits &= bits - 1)
+            {
+                uint8_t i = __builtin_ctzll(bits);
+                if (now - states[ch][i].since < LIMIT_SUMMARY_PERIOD)
+                    continue;
+                channel = ch + 1;
+                id = i;
+                return true;
+            }
+        return false;
+    }
+
+private:
+    struct limit_state
+    {
+        bool started;         //a frame was seen since the limit was set
+        unsigned long window; //limit_rate: start of the second
+        uint16_t passed;      //limit_rate: reports in it
+        uint16_t frames;      //limit_every: since the last report
+        uint8_t data_count;   //limit_delta: of the last report
+        uint8_t data[8];
+        uint32_t suppressed;  //since the last report
+        unsigned long since;  //first frame suppressed
+        unsigned long last;   //last frame suppressed
+    };
+
+    static bool differs(const id_limit &limit, const uint8_t *data, const uint8_t *reported)
+    {
+        for (uint8_t i = 0; i < 8; ++i)
+            if ((limit.mask >> i & 1) && abs((int)data[i] - (int)reported[i]) >= limit.value)
+                return true;
+        return false;
+    }
+
+    limit_state states[LIN_CHANNELS][LIN_MEM_SIZE];
+    uint64_t pending[LIN_CHANNELS]; //ids with suppressed frames, one bit per id
+};
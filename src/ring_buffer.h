@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+
+//single producer / single consumer ring buffer.
+//The producer (an interrupt) only writes head, the consumer (loop) only writes tail,
+//so no locking is needed. SIZE has to be a power of two, one slot is always kept free.
+template <typename T, uint16_t SIZE>
+class ring_buffer
+{
+    static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "ring_buffer SIZE must be a power of two");
+
+public:
+    //producer side - returns false (and counts it) if the buffer is full
+    bool push(const T &item)
+    {
+        uint16_t head = _head;
+        uint16_t next = (head + 1) & (SIZE - 1);
+        if (next == _tail)
+        {
+            ++overflows;
+            return false;
+        }
+        _items[head] = item;
+        __sync_synchronize(); //the item has to be stored before it is published
+        _head = next;
+        return true;
+    }
+
+    //consumer side - returns false if there is nothing to read
+    bool pop(T &item)
+    {
+        uint16_t tail = _tail;
+        if (tail == _head)
+            return false;
+        __sync_synchronize();
+        item = _items[tail];
+        __sync_synchronize(); //the item has to be read before the slot is released
+        _tail = (tail + 1) & (SIZE - 1);
+        return true;
+    }
+
+    //consumer side - reads the oldest item without removing it
+    bool peek(T &item)
+    {
+        if (_tail == _head)
+            return false;
+        __sync_synchronize();
+        item = _items[_tail];
+        return true;
+    }
+
+    bool empty() const { return _head == _tail; }
+    uint16_t size() const { return (_head - _tail) & (SIZE - 1); }
+    void clear() { _tail = _head; } //consumer side only
+
+    volatile uint32_t overflows = 0; //number of items lost because the buffer was full
+
+private:
+    T _items[SIZE];
+    volatile uint16_t _head = 0;
+    volatile uint16_t _tail = 0;
+};
@@ -0,0 +1,281 @@
+#pragma once
+#include "LIN_handler.h"
+#include "binary_protocol.h"
+
+#define SCHEDULE_MAX_SLOTS 32        //frames in one cycle of a schedule table
+#define SCHEDULE_LEARN_CYCLES 3      //times the ids have to repeat in the same order before they are taken as the schedule
+#define SCHEDULE_LEARN_FRAMES (SCHEDULE_MAX_SLOTS * SCHEDULE_LEARN_CYCLES)
+#define SCHEDULE_TABLES 4            //tables remembered per bus, so a switch back to one of them is recognized
+#define SCHEDULE_LOST_ANOMALIES 4    //frames in a row that do not fit the schedule before it is learned anew
+#define SCHEDULE_SILENT_CYCLES 2     //cycles without a frame before the schedule is reported as stopped
+#define SCHEDULE_DEFAULT_TOLERANCE 10 //percent of the nominal gap a frame may come early or late
+#define SCHEDULE_EVENTS 16           //events waiting for the host serial port, all buses. Has to be a power of two
+
+enum schedule_event_t
+{
+    schedule_none = 0,
+    schedule_learned = BIN_SCHEDULE_LEARNED,   //a table not seen before: table, slot count, cycle time (expected)
+    schedule_switched = BIN_SCHEDULE_SWITCHED, //the master switched to a table seen before: table
+    schedule_missing = BIN_SCHEDULE_MISSING,   //slots without their frame: first slot, id of it, count
+    schedule_extra = BIN_SCHEDULE_EXTRA,       //a frame that is not in the schedule at that time: id
+    schedule_jitter = BIN_SCHEDULE_JITTER,     //a frame too early or too late: slot, id, gap to the slot before (measured and expected)
+    schedule_lost = BIN_SCHEDULE_LOST          //the frames no longer fit the schedule or stopped, it is learned anew
+};
+
+//an anomaly (or change) of the schedule of a bus, with the time of the frame that showed it
+struct schedule_event
+{
+    schedule_event_t kind;
+    uint8_t channel;
+    uint8_t table; //number, from 1
+    uint8_t slot;  //from 0
+    uint8_t id;
+    uint8_t count;
+    unsigned long time;
+    uint32_t measured; //us
+    uint32_t expected; //us
+};
+
+//the slots of a schedule table as seen on the bus, gaps[i] is the nominal time from the break of slot i to the next one
+struct schedule_table
+{
+    uint8_t slot_count;
+    uint8_t ids[SCHEDULE_MAX_SLOTS];
+    uint32_t gaps[SCHEDULE_MAX_SLOTS];
+    uint32_t cycle_time;
+};
+
+enum schedule_state_t
+{
+    schedule_learning = 0,
+    schedule_following
+};
+
+//learns the schedule table of the master from the order of the ids and follows it frame by frame. Following is
+//a compare with the expected id and its gap, only frames that do not fit look further ahead in the table
+class schedule_monitor
+{
+public:
+    //clears the tables, the schedule is learned anew
+    void clear()
+    {
+        table_count = 0;
+        next_table = 0;
+        startLearning();
+    }
+
+    //a frame with a valid id was received, true if it showed something to report
+    bool frame(uint8_t id, unsigned long time, schedule_event &event)
+    {
+        event = {};
+        event.id = id;
+        event.time = time;
+        if (state == schedule_learning)
+            return learn(id, time, event);
+        const schedule_table &t = tables[current];
+        uint8_t previous = (pos + t.slot_count - 1) % t.slot_count;
+        uint32_t gap = time - last_time;
+        if (silent)
+        {
+            //the bus was quiet, continue at the first slot of the id
+            silent = false;
+            for (uint8_t s = 0; s < t.slot_count; ++s)
+                if (t.ids[s] == id)
+                {
+                    follow(s, time);
+                    return false;
+                }
+        }
+        else if (t.ids[pos] == id)
+        {
+            uint8_t slot = pos;
+            follow(pos, time);
+            if (fits(gap, t.gaps[previous]))
+                return false;
+            event.kind = schedule_jitter;
+            event.table = current + 1;
+            event.slot = slot;
+            event.measured = gap;
+            event.expected = t.gaps[previous];
+            return true;
+        }
+        else
+        {
+            //the frame of a later slot, at the time that one was due: the slots in between are missing
+            uint32_t due = t.gaps[previous];
+            for (uint8_t skipped = 1; skipped < t.slot_count; ++skipped)
+            {
+                uint8_t slot = (pos + skipped) % t.slot_count;
+                due += t.gaps[(slot + t.slot_count - 1) % t.slot_count];
+                if (t.ids[slot] != id || !fits(gap, due))
+                    continue;
+                event.kind = schedule_missing;
+                event.table = current + 1;
+                event.slot = pos;
+                event.id = t.ids[pos];
+                event.count = skipped;
+                follow(slot, time);
+                return true;
+            }
+        }
+        //not where the schedule has it
+        if (++anomalies < SCHEDULE_LOST_ANOMALIES)
+        {
+            event.kind = schedule_extra;
+            event.table = current + 1;
+            return true;
+        }
+        event.kind = schedule_lost;
+        event.table = current + 1;
+        startLearning();
+        learn(id, time, event);
+        return true;
+    }
+
+    //checks whether the bus stopped, called from loop()
+    bool poll(unsigned long now, schedule_event &event)
+    {
+        if (state != schedule_following || silent)
+            return false;
+        const schedule_table &t = tables[current];
+        if (now - last_time <= t.cycle_time * SCHEDULE_SILENT_CYCLES)
+            return false;
+        silent = true;
+        event = {};
+        event.kind = schedule_lost;
+        event.table = current + 1;
+        event.slot = pos;
+        event.id = t.ids[pos];
+        event.time = now;
+        event.measured = now - last_time;
+        event.expected = t.gaps[(pos + t.slot_count - 1) % t.slot_count];
+        return true;
+    }
+
+    bool learned() const { return state == schedule_following; }
+    uint8_t tableCount() const { return table_count; }
+    uint8_t currentTable() const { return current; }
+    const schedule_table &table(uint8_t index) const { return tables[index]; }
+
+    uint8_t tolerance = SCHEDULE_DEFAULT_TOLERANCE; //percent
+
+private:
+    bool fits(uint32_t gap, uint32_t expected) const
+    {
+        uint32_t deviation = gap > expected ? gap - expected : expected - gap;
+        return (uint64_t)deviation * 100 <= (uint64_t)expected * tolerance;
+    }
+
+    void follow(uint8_t slot, unsigned long time)
+    {
+        pos = (slot + 1) % tables[current].slot_count;
+        last_time = time;
+        anomalies = 0;
+    }
+
+    void startLearning()
+    {
+        state = schedule_learning;
+        learn_count = 0;
+        period = 1;
+        silent = false;
+    }
+
+    //the shortest period the ids so far repeat with. It only grows, so every frame costs little on average
+    bool learn(uint8_t id, unsigned long time, schedule_event &event)
+    {
+        learn_ids[learn_count] = id;
+        learn_times[learn_count] = time;
+        ++learn_count;
+        while (period < learn_count && !repeats(period))
+            ++period;
+        if (period <= SCHEDULE_MAX_SLOTS && learn_count >= period * SCHEDULE_LEARN_CYCLES && period < learn_count)
+            return adopt(event);
+        if (learn_count == SCHEDULE_LEARN_FRAMES)
+            startLearning(); //no schedule that fits, maybe a switch while learning
+        return false;
+    }
+
+    bool repeats(uint8_t candidate) const
+    {
+        for (uint8_t i = candidate; i < learn_count; ++i)
+            if (learn_ids[i] != learn_ids[i - candidate])
+                return false;
+        return true;
+    }
+
+    //takes the learned ids as the schedule: one of the known tables or a new one
+    bool adopt(schedule_event &event)
+    {
+        schedule_table learned;
+        learned.slot_count = period;
+        uint8_t cycles = learn_count / period;
+        learned.cycle_time = (learn_times[(cycles - 1) * period] - learn_times[0]) / (cycles - 1);
+        for (uint8_t s = 0; s < period; ++s)
+        {
+            learned.ids[s] = learn_ids[s];
+            //averaged over every cycle that has the gap
+            uint64_t sum = 0;
+            uint8_t gaps = 0;
+            for (uint16_t i = s; i + 1 < learn_count; i += period)
+            {
+                sum += learn_times[i + 1] - learn_times[i];
+                ++gaps;
+            }
+            learned.gaps[s] = sum / gaps;
+        }
+        uint8_t next = learn_count % period; //slot of the next frame in the learned order
+        event.count = period;
+        event.expected = learned.cycle_time;
+        state = schedule_following;
+        anomalies = 0;
+        last_time = learn_times[learn_count - 1];
+        //the same ids in the same order, maybe started at another slot
+        for (uint8_t index = 0; index < table_count; ++index)
+        {
+            const schedule_table &known = tables[index];
+            if (known.slot_count != period)
+                continue;
+            for (uint8_t rotation = 0; rotation < period; ++rotation)
+            {
+                bool same = true;
+                for (uint8_t s = 0; s < period && same; ++s)
+                    same = known.ids[(s + rotation) % period] == learned.ids[s];
+                if (!same)
+                    continue;
+                bool again = index == current;
+                current = index;
+                pos = (next + rotation) % period;
+                event.kind = schedule_switched;
+                event.table = index + 1;
+                //back on the same table after losing it, nothing changed
+                return !again;
+            }
+        }
+        current = next_table;
+        tables[current] = learned;
+        pos = next;
+        next_table = (next_table + 1) % SCHEDULE_TABLES;
+        if (table_count < SCHEDULE_TABLES)
+            ++table_count;
+        event.kind = schedule_learned;
+        event.table = current + 1;
+        return true;
+    }
+
+    schedule_table tables[SCHEDULE_TABLES];
+    uint8_t table_count = 0;
+    uint8_t next_table = 0; //replaced by the next new table
+    uint8_t current = 0;    //the table being followed
+    schedule_state_t state = schedule_learning;
+    //following
+    uint8_t pos;             //the slot expected next
+    unsigned long last_time; //of the last frame that was in its slot
+    uint8_t anomalies;       //frames in a row that did not fit
+    bool silent = false;     //no frames for SCHEDULE_SILENT_CYCLES cycles
+    //learning
+    uint8_t learn_ids[SCHEDULE_LEARN_FRAMES];
+    unsigned long learn_times[SCHEDULE_LEARN_FRAMES];
+    uint8_t learn_count = 0;
+    uint8_t period = 1;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include "LIN_hal.h"
+
+#define SCHEDULER_TASKS 8 //tasks besides the urgent one
+
+//a part of the main loop. A call does a bounded slice of its work, what is left is done on its next call
+struct task
+{
+    const char *name;
+    void (*run)();
+    uint32_t calls;
+    uint32_t max_cycles; //worst case execution time of a call, without the urgent task run from it
+};
+
+//runs the tasks of the main loop in turn, one per call of run(), with the urgent task (the reception) in front of
+//every one of them. A task that has to wait (a full transmit buffer) calls yield(), so the urgent task runs then as
+//well. The time from a break to the reception taking it is bounded by the longest task between two urgent runs
+class task_scheduler
+{
+public:
+    void setUrgent(const char *name, void (*run)()) { urgent = {name, run, 0, 0}; }
+
+    void add(const char *name, void (*run)())
+    {
+        if (count < SCHEDULER_TASKS)
+            tasks[count++] = {name, run, 0, 0};
+    }
+
+    //the urgent task, then the next task
+    void run()
+    {
+        runUrgent();
+        if (!count)
+            return;
+        task &t = tasks[next];
+        next = (next + 1) % count;
+        running = true;
+        yielded_cycles = 0;
+        uint32_t start = hal::cycles();
+        t.run();
+        uint32_t end = hal::cycles();
+        uint32_t cycles = end - start - yielded_cycles;
+        running = false;
+        gap(end);
+        ++t.calls;
+        if (cycles > t.max_cycles)
+            t.max_cycles = cycles;
+    }
+
+    //called from a task that waits, the urgent task runs if it is not the one waiting
+    void yield()
+    {
+        if (!running || in_urgent)
+            return;
+        uint32_t start = hal::cycles();
+        gap(start);
+        runUrgent();
+        yielded_cycles += hal::cycles() - start;
+    }
+
+    //the worst case times start over
+    void clear()
+    {
+        urgent.calls = 0;
+        urgent.max_cycles = 0;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            tasks[i].calls = 0;
+            tasks[i].max_cycles = 0;
+        }
+        max_gap_cycles = 0;
+    }
+
+    uint8_t size() const { return count; }
+    const task &at(uint8_t index) const { return tasks[index]; }
+    const task &urgentTask() const { return urgent; }
+    //the longest a task ran without the urgent task, from the end of an urgent run to the end of the task or its yield()
+    uint32_t maxGapCycles() const { return max_gap_cycles; }
+
+private:
+    void gap(uint32_t now)
+    {
+        if (now - last_urgent > max_gap_cycles)
+            max_gap_cycles = now - last_urgent;
+    }
+
+    void runUrgent()
+    {
+        in_urgent = true;
+        uint32_t start = hal::cycles();
+        urgent.run();
+        uint32_t end = hal::cycles();
+        ++urgent.calls;
+        if (end - start > urgent.max_cycles)
+            urgent.max_cycles = end - start;
+        last_urgent = end;
+        in_urgent = false;
+    }
+
+    task urgent = {};
+    task tasks[SCHEDULER_TASKS];
+    uint8_t count = 0;
+    uint8_t next = 0;
+    bool running = false;         //a task is being run
+    bool in_urgent = false;       //the urgent task is being run
+    uint32_t yielded_cycles;      //spent in the urgent task during the running task
+    uint32_t last_urgent;         //cycles at the end of the last urgent run
+    uint32_t max_gap_cycles = 0;
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <stddef.h>
+#include "LIN_hal.h"
+#include "signals.h"
+
+//the settings are saved as an image: a header, the bytes of the config, the number of signals and their definitions.
+//Saves go to the two slots in turn and the page with the header is written last, so a reset while saving
+//leaves the image before it. The image is written one flash page per step, between the frames
+#define SETTINGS_MAGIC 0x534E494CUL //"LINS"
+#define SETTINGS_VERSION 1          //of the layout of the image. The config in it only grows at its end, its size is stored
+#define SETTINGS_PAGE 256           //flash page of the SAM3X, erased and written at once
+#define SETTINGS_SLOT_SIZE 4096
+#define SETTINGS_SLOT_A 4096 //behind the settings and signals of the layout before the image (addresses 0 - 2559)
+#define SETTINGS_SLOT_B (SETTINGS_SLOT_A + SETTINGS_SLOT_SIZE)
+#define SETTINGS_MAX_DEFER 200000UL //us a page waits for every bus to be between frames, then it is written anyway
+
+//in front of the image, crc covers the header fields before it and everything behind the header
+struct settings_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;   //bytes behind the header
+    uint32_t sequence; //counts the saves, the slot with the higher one is newer
+    uint32_t crc;      //CRC-32
+};
+
+enum settings_step_t
+{
+    settings_idle = 0, //nothing to write
+    settings_writing,  //a page was written, more are to come
+    settings_saved,    //the last page was written and the image read back
+    settings_failed    //the flash did not take the image, the slot before it is still valid
+};
+
+//saves and loads the settings of type CONFIG with the signals
+template <typename CONFIG>
+class settings_store
+{
+public:
+    //the newest valid image: config gets its bytes (a shorter config of an older firmware leaves the rest 0xFF,
+    //like erased flash) and signals its definitions. False if neither slot has one
+    bool load(uint8_t *config, signal_db &signals)
+    {
+        uint32_t sequences[2];
+        bool valid[2] = {check(0, sequences[0]), check(1, sequences[1])};
+        if (!valid[0] && !valid[1])
+            return false;
+        slot = !valid[1] || (valid[0] && (int32_t)(sequences[0] - sequences[1]) > 0) ? 0 : 1;
+        sequence = sequences[slot];
+        uint32_t address = addressOf(slot) + sizeof(settings_header);
+        uint16_t config_size = read(address) | read(address + 1) << 8;
+        address += 2;
+        memset(config, 0xFF, sizeof(CONFIG));
+        for (uint16_t i = 0; i < config_size && i < sizeof(CONFIG); ++i)
+            config[i] = read(address + i);
+        address += config_size;
+        uint8_t count = read(address++);
+        signals.clear();
+        for (uint8_t i = 0; i < count; ++i, address += sizeof(signal_def))
+        {
+            signal_def signal;
+            for (uint16_t b = 0; b < sizeof(signal_def); ++b)
+                ((uint8_t *)&signal)[b] = read(address + b);
+            signals.add(signal);
+        }
+        return true;
+    }
+
+    //puts the image together, step() writes it to the slot that does not have the newest one. A save while
+    //the last one is written starts anew
+    void save(const CONFIG &config, const signal_db &signals)
+    {
+        uint8_t *payload = image + sizeof(settings_header);
+        uint16_t length = 0;
+        payload[length++] = sizeof(CONFIG) & 0xFF;
+        payload[length++] = sizeof(CONFIG) >> 8;
+        memcpy(payload + length, &config, sizeof(CONFIG));
+        length += sizeof(CONFIG);
+        payload[length++] = signals.size();
+        for (uint8_t i = 0; i < signals.size(); ++i, length += sizeof(signal_def))
+            memcpy(payload + length, &signals.def(i), sizeof(signal_def));
+        settings_header header = {SETTINGS_MAGIC, SETTINGS_VERSION, length, sequence + 1, 0};
+        memcpy(image, &header, sizeof(header));
+        header.crc = imageCrc(length);
+        memcpy(image, &header, sizeof(header));
+        pages = (sizeof(settings_header) + length + SETTINGS_PAGE - 1) / SETTINGS_PAGE;
+        next_page = 1 % pages;
+        written = 0;
+        target = slot ^ 1;
+    }
+
+    bool writing() const { return written < pages; }
+
+    //writes the next page of the image, called from loop() while no bus receives a frame.
+    //The pages behind the header go first, the one with the header completes the image
+    settings_step_t step()
+    {
+        if (!writing())
+            return settings_idle;
+        bool ok = hal::storageWrite(addressOf(target) + next_page * SETTINGS_PAGE, image + next_page * SETTINGS_PAGE, SETTINGS_PAGE);
+        next_page = (next_page + 1) % pages;
+        if (!ok)
+        {
+            pages = 0;
+            return settings_failed;
+        }
+        if (++written < pages)
+            return settings_writing;
+        uint32_t saved;
+        if (!check(target, saved) || saved != sequence + 1)
+            return settings_failed;
+        slot = target;
+        sequence = saved;
+        return settings_saved;
+    }
+
+private:
+    static uint32_t addressOf(uint8_t index) { return index ? SETTINGS_SLOT_B : SETTINGS_SLOT_A; }
+    static uint8_t read(uint32_t address) { return hal::storageRead(address); }
+
+    //CRC-32 (IEEE 802.3), bitwise - it is worked out once per save and twice at startup
+    static uint32_t crc32(uint32_t crc, const uint8_t *bytes, uint16_t count)
+    {
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            crc ^= bytes[i];
+            for (uint8_t bit = 0; bit < 8; ++bit)
+                crc = crc >> 1 ^ (0xEDB88320UL & -(crc & 1));
+        }
+        return crc;
+    }
+
+    //of the header fields in front of crc and the length bytes behind the header
+    uint32_t imageCrc(uint16_t length) const
+    {
+        uint32_t crc = crc32(0xFFFFFFFF, image, offsetof(settings_header, crc));
+        return ~crc32(crc, image + sizeof(settings_header), length);
+    }
+
+    //whether the slot has a complete image of this layout, and its sequence. Reads it into image, so it
+    //is only called while nothing is written
+    bool check(uint8_t index, uint32_t &saved)
+    {
+        uint32_t address = addressOf(index);
+        settings_header header;
+        for (uint16_t b = 0; b < sizeof(header); ++b)
+            ((uint8_t *)&header)[b] = read(address + b);
+        if (header.magic != SETTINGS_MAGIC || header.version != SETTINGS_VERSION || header.length > sizeof(image) - sizeof(header))
+            return false;
+        for (uint16_t b = 0; b < sizeof(header) + header.length; ++b)
+            image[b] = read(address + b);
+        saved = header.sequence;
+        return imageCrc(header.length) == header.crc;
+    }
+
+    //header + config size + config + signal count + signals, rounded up to whole pages
+    static const uint16_t IMAGE_SIZE = (sizeof(settings_header) + 2 + sizeof(CONFIG) + 1 + SIGNAL_COUNT * sizeof(signal_def) + SETTINGS_PAGE - 1) / SETTINGS_PAGE * SETTINGS_PAGE;
+    static_assert(IMAGE_SIZE <= SETTINGS_SLOT_SIZE, "the settings do not fit their slot");
+
+    uint8_t image[IMAGE_SIZE]; //being written
+    uint8_t pages = 0;         //of the image
+    uint8_t next_page;
+    uint8_t written = 0; //pages
+    uint8_t target;      //slot being written
+    uint8_t slot = 1;    //has the newest image, the first save goes to slot 0
+    uint32_t sequence = 0;
+};
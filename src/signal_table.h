@@ -0,0 +1,13 @@
+#pragma once
+#include "signals.h"
+
+//signals compiled into the sniffer, e.g. written from the LDF of the bus. They are loaded at start unless
+//signals were saved with 'save'. One line per signal, the table ends with the empty entry:
+//  {name, id, channel (0 - any), start bit, length, scale, offset}
+//start bit and length as in the LDF: bit 0 is the least significant bit of the first data byte.
+//physical value = raw value * scale + offset
+const signal_def SIGNAL_TABLE[] = {
+    //{"speed", 0x21, 0, 0, 16, 0.01f, 0.0f},
+    //{"gear", 0x21, 0, 16, 4, 1.0f, -1.0f},
+    {},
+};
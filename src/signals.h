@@ -0,0 +1,206 @@
+#pragma once
+#include <math.h>
+#include "LIN_hal.h"
+#include "LIN_handler.h"
+#include "binary_protocol.h"
+
+#define SIGNAL_COUNT 64     //signals that can be defined
+#define SIGNALS_PER_ID BIN_MAX_SIGNALS //signals of one id, all buses together - one record_signals
+#define SIGNAL_NAME_SIZE 12 //with the terminating zero
+#define SIGNAL_DECIMALS 3   //most decimals shown of a physical value
+#define SIGNAL_STORAGE 1024 //flash address of the signals saved before the settings image (settings.h)
+
+static_assert(SIGNALS_PER_ID <= 8, "the changed signals of a frame are one byte");
+
+//a signal as it is defined: compiled in (signal_table.h), added with 'signal add' and saved
+struct signal_def
+{
+    char name[SIGNAL_NAME_SIZE];
+    uint8_t id;
+    uint8_t channel;   //0 - any bus
+    uint8_t start_bit; //bit 0 is the least significant bit of data byte 0
+    uint8_t length;    //bits, 1..32
+    float scale;       //physical value = raw value * scale + offset
+    float offset;
+};
+
+//how the raw value is taken out of the data, worked out once when the signal is added
+struct signal_decoder
+{
+    uint8_t first_byte; //the data bytes the signal lies in
+    uint8_t byte_count;
+    uint8_t shift; //of the value within them
+    uint8_t decimals;
+    uint32_t mask;
+};
+
+//the signals of every id. A frame only looks at the (at most SIGNALS_PER_ID) signals of its id, and each of them
+//is a few byte loads, a shift and a mask - so the signals of every frame can be compared at full bus load
+class signal_db
+{
+public:
+    uint8_t size() const { return count; }
+    const signal_def &def(uint8_t index) const { return defs[index]; }
+    uint8_t decimals(uint8_t index) const { return decoders[index].decimals; }
+
+    //adds the signal, replaces the one with the same name. False if it is not valid or there is no room
+    bool add(const signal_def &signal)
+    {
+        if (!signal.name[0] || signal.id >= LIN_MEM_SIZE || signal.channel > LIN_CHANNELS ||
+            signal.length < 1 || signal.length > 32 || signal.start_bit + signal.length > 64 ||
+            !isfinite(signal.scale) || !isfinite(signal.offset))
+            return false;
+        int8_t index = find(signal.name);
+        if (index < 0)
+        {
+            if (count == SIGNAL_COUNT || id_count[signal.id] == SIGNALS_PER_ID)
+                return false;
+            index = count++;
+        }
+        else if (defs[index].id != signal.id && id_count[signal.id] == SIGNALS_PER_ID)
+            return false;
+        defs[index] = signal;
+        defs[index].name[SIGNAL_NAME_SIZE - 1] = '\0';
+        signal_decoder &d = decoders[index];
+        d.first_byte = signal.start_bit / 8;
+        d.byte_count = (signal.start_bit % 8 + signal.length + 7) / 8;
+        d.shift = signal.start_bit % 8;
+        d.mask = signal.length == 32 ? 0xFFFFFFFF : ((uint32_t)1 << signal.length) - 1;
+        uint8_t scale_decimals = decimalsOf(signal.scale);
+        uint8_t offset_decimals = decimalsOf(signal.offset);
+        d.decimals = scale_decimals > offset_decimals ? scale_decimals : offset_decimals;
+        updateIds();
+        return true;
+    }
+
+    bool remove(const char *name)
+    {
+        int8_t index = find(name);
+        if (index < 0)
+            return false;
+        --count;
+        for (uint8_t i = index; i < count; ++i)
+        {
+            defs[i] = defs[i + 1];
+            decoders[i] = decoders[i + 1];
+        }
+        updateIds();
+        return true;
+    }
+
+    void clear()
+    {
+        count = 0;
+        updateIds();
+    }
+
+    //adds the signals of a table ending with an empty name
+    void add(const signal_def *table)
+    {
+        for (; table->name[0]; ++table)
+            add(*table);
+    }
+
+    //whether the id has signals on the bus
+    bool has(uint8_t channel, uint8_t id) const { return id_channels[id] & (1 | 1 << channel); }
+
+    //the signals of the id, numbered by place. Their bits in changed() are by place as well
+    uint8_t signalsOf(uint8_t id) const { return id_count[id]; }
+    uint8_t signalAt(uint8_t id, uint8_t place) const { return by_id[id][place]; }
+
+    //the signals of the frame whose raw value differs from the old frame, every signal in it without one
+    uint8_t changed(const data_frame &frame, const data_frame *old) const
+    {
+        uint8_t result = 0;
+        for (uint8_t place = 0; place < id_count[frame.id]; ++place)
+        {
+            uint8_t index = by_id[frame.id][place];
+            if (!inFrame(index, frame))
+                continue;
+            if (!old || !inFrame(index, *old) || raw(index, frame) != raw(index, *old))
+                result |= 1 << place;
+        }
+        return result;
+    }
+
+    //whether the frame is of the signal's bus and long enough for it
+    bool inFrame(uint8_t index, const data_frame &frame) const
+    {
+        const signal_decoder &d = decoders[index];
+        return (!defs[index].channel || defs[index].channel == frame.channel) && d.first_byte + d.byte_count <= frame.data_count;
+    }
+
+    uint32_t raw(uint8_t index, const data_frame &frame) const
+    {
+        const signal_decoder &d = decoders[index];
+        uint64_t bits = 0;
+        for (uint8_t i = 0; i < d.byte_count; ++i)
+            bits |= (uint64_t)frame.data[d.first_byte + i] << (8 * i);
+        return (bits >> d.shift) & d.mask;
+    }
+
+    float value(uint8_t index, const data_frame &frame) const
+    {
+        return raw(index, frame) * defs[index].scale + defs[index].offset;
+    }
+
+    //the signals as saved before the settings image: a zero byte if signals are saved, their number, then the
+    //definitions. False if no signals are saved
+    bool loadOld()
+    {
+        if (hal::storageRead(SIGNAL_STORAGE) != 0)
+            return false;
+        uint8_t saved = hal::storageRead(SIGNAL_STORAGE + 1);
+        clear();
+        for (uint8_t i = 0; i < saved && i < SIGNAL_COUNT; ++i)
+        {
+            signal_def signal;
+            uint8_t *bytes = (uint8_t *)&signal;
+            for (uint32_t b = 0; b < sizeof(signal_def); ++b)
+                bytes[b] = hal::storageRead(SIGNAL_STORAGE + 4 + i * sizeof(signal_def) + b);
+            add(signal);
+        }
+        return true;
+    }
+
+private:
+    int8_t find(const char *name) const
+    {
+        for (uint8_t i = 0; i < count; ++i)
+            if (!strncmp(defs[i].name, name, SIGNAL_NAME_SIZE - 1))
+                return i;
+        return -1;
+    }
+
+    //decimals needed to show multiples of the value, at most SIGNAL_DECIMALS
+    static uint8_t decimalsOf(float value)
+    {
+        float scaled = fabsf(value);
+        uint8_t decimals = 0;
+        while (decimals < SIGNAL_DECIMALS && fabsf(scaled - roundf(scaled)) > scaled * 1e-4f)
+        {
+            scaled *= 10;
+            ++decimals;
+        }
+        return decimals;
+    }
+
+    void updateIds()
+    {
+        memset(id_count, 0, sizeof(id_count));
+        memset(id_channels, 0, sizeof(id_channels));
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            uint8_t id = defs[i].id;
+            by_id[id][id_count[id]++] = i;
+            id_channels[id] |= 1 << defs[i].channel;
+        }
+    }
+
+    signal_def defs[SIGNAL_COUNT];
+    signal_decoder decoders[SIGNAL_COUNT];
+    uint8_t count = 0;
+    uint8_t by_id[LIN_MEM_SIZE][SIGNALS_PER_ID]; //indices of the signals of every id
+    uint8_t id_count[LIN_MEM_SIZE] = {};
+    uint8_t id_channels[LIN_MEM_SIZE] = {}; //bit 0 - a signal of any bus, bit n - of channel n
+};
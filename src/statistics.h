@@ -0,0 +1,169 @@
+#pragma once
+#include "LIN_handler.h"
+#include "output_queue.h"
+
+#define STATS_COLLECT_LOOPS 256 //loop() iterations between collecting the maxima and the time
+
+//counters of one bus at the start of a statistics window
+struct bus_counters_t
+{
+    uint32_t frames;
+    uint32_t glitches;
+    uint32_t dropped_frames;
+    uint64_t busy_time;
+    uint64_t callback_cycles;
+};
+
+//a stretch of time the statistics are reported for: since 'stats clear' or since the last periodic record
+struct stats_window
+{
+    uint64_t elapsed;                    //us
+    bus_counters_t start[LIN_CHANNELS];  //what the buses had counted when the window started
+    uint32_t max_loop_cycles;            //the longest loop() iteration
+    uint32_t max_callback_cycles;        //the longest Mark* callback, of any bus
+    uint16_t high_water;                 //the most reports waiting for the host serial port
+};
+
+//what is reported about a window
+struct bus_stats_t
+{
+    uint8_t channel;
+    uint32_t frames;
+    uint32_t frames_per_second10; //frames per 10 seconds, one decimal of the frames per second
+    uint16_t load_permille;
+    uint32_t glitches;
+    uint32_t dropped_frames;
+};
+
+struct stats_t
+{
+    uint32_t period_ms;
+    uint32_t max_loop_ns;
+    uint16_t callback_permille; //share of the time spent in the Mark* callbacks, all buses
+    uint32_t max_callback_ns;
+    uint16_t high_water;
+    bus_stats_t buses[LIN_CHANNELS];
+};
+
+//runtime statistics of the sniffer. The buses only count (a few increments per frame) and loop() only compares
+//its time to the longest one. Every STATS_COLLECT_LOOPS iterations the time and the maxima are collected here
+class run_stats
+{
+public:
+    run_stats(lin_bus *const *_buses, output_queue &_queue) : buses(_buses), queue(_queue) {}
+
+    //sets every counter to zero, both windows start over
+    void clear()
+    {
+        for (uint8_t i = 0; i < LIN_CHANNELS; ++i)
+            buses[i]->clearStats();
+        max_loop_cycles = 0;
+        queue.high_water = queue.size();
+        begin(total);
+        begin(period);
+        last_time = hal::timestamp();
+    }
+
+    //called at the end of every loop() with the cycles it took
+    void tick(uint32_t loop_cycles)
+    {
+        if (loop_cycles > max_loop_cycles)
+            max_loop_cycles = loop_cycles;
+        if (++ticks == STATS_COLLECT_LOOPS)
+            collect();
+    }
+
+    //brings both windows up to date
+    void collect()
+    {
+        ticks = 0;
+        unsigned long now = hal::timestamp();
+        uint32_t elapsed = now - last_time;
+        last_time = now;
+        total.elapsed += elapsed;
+        period.elapsed += elapsed;
+        uint32_t callback = 0;
+        for (uint8_t i = 0; i < LIN_CHANNELS; ++i)
+        {
+            if (buses[i]->max_callback_cycles > callback)
+                callback = buses[i]->max_callback_cycles;
+            buses[i]->max_callback_cycles = 0;
+        }
+        update(total, callback);
+        update(period, callback);
+        max_loop_cycles = 0;
+        //the queue's high water mark is taken over every time
+        queue.high_water = queue.size();
+    }
+
+    //true once per period_ms (if it is set), the values of the period are in result
+    bool periodDone(stats_t &result)
+    {
+        if (!period_ms || period.elapsed < (uint64_t)period_ms * 1000)
+            return false;
+        report(period, result);
+        begin(period);
+        return true;
+    }
+
+    //the windows are as of the last collect()
+    void report(const stats_window &window, stats_t &result)
+    {
+        uint64_t elapsed = window.elapsed ? window.elapsed : 1;
+        result.period_ms = window.elapsed / 1000;
+        result.max_loop_ns = (uint64_t)window.max_loop_cycles * 1000 / hal::cyclesPerMicrosecond();
+        result.max_callback_ns = (uint64_t)window.max_callback_cycles * 1000 / hal::cyclesPerMicrosecond();
+        result.high_water = window.high_water;
+        uint64_t callback_cycles = 0;
+        for (uint8_t i = 0; i < LIN_CHANNELS; ++i)
+        {
+            const lin_bus *bus = buses[i];
+            const bus_counters_t &start = window.start[i];
+            bus_stats_t &out = result.buses[i];
+            out.channel = bus->channel;
+            out.frames = bus->frames - start.frames;
+            out.frames_per_second10 = (uint64_t)out.frames * 10000000 / elapsed;
+            uint64_t load = (bus->busy_time - start.busy_time) * 1000 / elapsed;
+            out.load_permille = load > 1000 ? 1000 : load;
+            out.glitches = bus->glitches - start.glitches;
+            out.dropped_frames = bus->dropped_frames - start.dropped_frames;
+            callback_cycles += bus->callback_cycles - start.callback_cycles;
+        }
+        uint64_t permille = callback_cycles * 1000 / (elapsed * hal::cyclesPerMicrosecond());
+        result.callback_permille = permille > 1000 ? 1000 : permille;
+    }
+
+    stats_window total;  //since the start or 'stats clear'
+    stats_window period; //since the last periodic record
+    uint32_t period_ms = 0; //periodic records, 0 - off
+
+private:
+    void begin(stats_window &window)
+    {
+        window.elapsed = 0;
+        window.max_loop_cycles = 0;
+        window.max_callback_cycles = 0;
+        window.high_water = 0;
+        for (uint8_t i = 0; i < LIN_CHANNELS; ++i)
+        {
+            const lin_bus *bus = buses[i];
+            window.start[i] = {bus->frames, bus->glitches, bus->dropped_frames, bus->busy_time, bus->callback_cycles};
+        }
+    }
+
+    void update(stats_window &window, uint32_t callback_cycles)
+    {
+        if (max_loop_cycles > window.max_loop_cycles)
+            window.max_loop_cycles = max_loop_cycles;
+        if (callback_cycles > window.max_callback_cycles)
+            window.max_callback_cycles = callback_cycles;
+        if (queue.high_water > window.high_water)
+            window.high_water = queue.high_water;
+    }
+
+    lin_bus *const *buses;
+    output_queue &queue;
+    unsigned long last_time = 0;
+    uint32_t max_loop_cycles = 0; //the longest loop() since the last collect()
+    uint16_t ticks = 0;
+};
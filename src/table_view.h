@@ -0,0 +1,216 @@
+#pragma once
+#include "LIN_handler.h"
+#include "line_buffer.h"
+
+#define TABLE_ROWS (LIN_CHANNELS * LIN_MEM_SIZE) //every id of every bus
+#define TABLE_FIRST_ROW 3                        //screen row of the first id, below the title and the column names
+#define TABLE_DATA_COLUMN 8                      //screen column of data byte 0, behind "1:3c | "
+#define TABLE_COUNT_COLUMN (TABLE_DATA_COLUMN + 8 * 3) //"| " and the frames
+#define TABLE_AGE_COLUMN (TABLE_COUNT_COLUMN + 15)
+#define TABLE_MAX_AGE 999999 //tenths of a second shown at most
+#define TABLE_DEFAULT_REFRESH 200 //ms
+#define TABLE_MIN_REFRESH 20
+#define TABLE_MAX_REFRESH 10000
+
+//what a row of the table shows, the screen is only written where the frame memory of the bus differs from it
+struct table_row
+{
+    uint8_t channel;
+    uint8_t id;
+    bool drawn;
+    uint8_t data_count;
+    uint8_t data[8];
+    uint32_t count;
+    uint32_t age; //tenths of a second
+};
+
+//one fixed row per id seen on any bus, in the order they were first seen: channel:id, the data of the last frame,
+//the frames counted and the age of the last one. Every refresh period the cells that changed are rewritten in place
+//with cursor positioning (ANSI), so the output grows with the changes and the rows, not with the frames
+class table_view
+{
+public:
+    unsigned long refresh = TABLE_DEFAULT_REFRESH * 1000UL; //us
+
+    //the screen is drawn anew on the next draw()
+    void start()
+    {
+        row_count = 0;
+        memset(row_of, 0xFF, sizeof(row_of));
+        cleared = false;
+        refreshing = false;
+    }
+
+    //screen row below the table, where command replies go
+    uint16_t bottom() const { return TABLE_FIRST_ROW + row_count + 1; }
+
+    //puts the next part of the screen that is due into out, false if there is nothing to write
+    bool draw(line_buffer &out, lin_bus *const *buses, unsigned long now)
+    {
+        if (!cleared)
+        {
+            cleared = true;
+            out.put("\e[2J\e[H");
+            out.put("LIN sniffer - view table, refresh ");
+            out.putDec(refresh / 1000);
+            out.put(" ms\r\n");
+            out.put("c:id | data                    |     frames |   age s\r\n");
+            last_refresh = now - refresh;
+            return true;
+        }
+        if (!refreshing)
+        {
+            if (now - last_refresh < refresh)
+                return false;
+            last_refresh = now;
+            refreshing = true;
+            written = false;
+            pos = 0;
+            addRows(buses);
+        }
+        while (pos < row_count)
+        {
+            table_row &row = rows[pos];
+            uint16_t screen_row = TABLE_FIRST_ROW + pos++;
+            if (update(out, row, buses[row.channel - 1], screen_row, now))
+            {
+                written = true;
+                return true;
+            }
+        }
+        refreshing = false;
+        if (!written)
+            return false;
+        //the cursor waits below the table, for the echo of commands
+        moveTo(out, bottom(), 1);
+        return true;
+    }
+
+private:
+    //ids seen since the last refresh get the next rows
+    void addRows(lin_bus *const *buses)
+    {
+        for (uint8_t ch = 0; ch < LIN_CHANNELS; ++ch)
+        {
+            uint64_t saved = buses[ch]->saved_frames;
+            for (uint8_t id = 0; id < LIN_MEM_SIZE; ++id)
+            {
+                if (!(saved >> id & 1) || row_of[ch][id] != 0xFF)
+                    continue;
+                row_of[ch][id] = row_count;
+                table_row &row = rows[row_count++];
+                row.channel = ch + 1;
+                row.id = id;
+                row.drawn = false;
+            }
+        }
+    }
+
+    static void moveTo(line_buffer &out, uint16_t row, uint8_t column)
+    {
+        out.put("\e[");
+        out.putDec(row);
+        out.put(';');
+        out.putDec(column);
+        out.put('H');
+    }
+
+    static void putCell(line_buffer &out, const table_row &row, uint8_t index)
+    {
+        if (index < row.data_count)
+            out.putHex(row.data[index]);
+        else
+            out.put("  ");
+    }
+
+    //the cells of the row that changed, false if none did
+    bool update(line_buffer &out, table_row &row, lin_bus *bus, uint16_t screen_row, unsigned long now)
+    {
+        const data_frame &frame = bus->FRAME_MEMORY[row.id];
+        uint32_t count = bus->frame_count[row.id];
+        uint32_t age = (now - frame.time) / 100000;
+        if (age > TABLE_MAX_AGE)
+            age = TABLE_MAX_AGE;
+        if (!row.drawn)
+        {
+            row.drawn = true;
+            row.data_count = frame.data_count;
+            memcpy(row.data, frame.data, sizeof(row.data));
+            row.count = count;
+            row.age = age;
+            moveTo(out, screen_row, 1);
+            out.put('0' + row.channel);
+            out.put(':');
+            out.putHex(row.id);
+            out.put(" | ");
+            for (uint8_t i = 0; i < 8; ++i)
+            {
+                putCell(out, row, i);
+                out.put(' ');
+            }
+            putCount(out, row);
+            out.put(" | ");
+            putAge(out, row);
+            return true;
+        }
+        uint16_t length = out.length;
+        //runs of changed cells share the cursor move
+        bool in_run = false;
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            bool shown = i < row.data_count;
+            bool now_shown = i < frame.data_count;
+            if (shown == now_shown && (!shown || row.data[i] == frame.data[i]))
+            {
+                in_run = false;
+                continue;
+            }
+            if (!in_run)
+                moveTo(out, screen_row, TABLE_DATA_COLUMN + 3 * i);
+            else
+                out.put(' ');
+            in_run = true;
+            row.data[i] = frame.data[i];
+            if (now_shown)
+                out.putHex(frame.data[i]);
+            else
+                out.put("  ");
+        }
+        row.data_count = frame.data_count;
+        if (count != row.count)
+        {
+            row.count = count;
+            moveTo(out, screen_row, TABLE_COUNT_COLUMN);
+            putCount(out, row);
+        }
+        if (age != row.age)
+        {
+            row.age = age;
+            moveTo(out, screen_row, TABLE_AGE_COLUMN);
+            putAge(out, row);
+        }
+        return out.length != length;
+    }
+
+    static void putCount(line_buffer &out, const table_row &row)
+    {
+        out.put("| ");
+        out.putDec(row.count, 10);
+    }
+
+    static void putAge(line_buffer &out, const table_row &row)
+    {
+        out.putDec(row.age / 10, 5);
+        out.put('.');
+        out.put('0' + row.age % 10);
+    }
+
+    table_row rows[TABLE_ROWS];
+    uint8_t row_of[LIN_CHANNELS][LIN_MEM_SIZE]; //0xFF - no row yet
+    uint8_t row_count = 0;
+    bool cleared = false;    //the title and the column names are on the screen
+    bool refreshing = false; //the rows are being compared, pos is the next one
+    bool written;            //a row changed in this refresh
+    uint8_t pos;
+    unsigned long last_refresh;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+//LIN 2.x: header and response may take up to 1.4 times their nominal time (see LIN_MAX_FRAME_TIME)
+#define TIMING_TOLERANCE_PERCENT 140
+#define TIMING_HEADER_BITS 34 //break 13 + delimiter 1 + sync 10 + pid 10
+#define TIMING_BREAK_BITS 13
+#define TIMING_BINS 8
+#define TIMING_BIN_FULL 0xFFFF //a bin stops counting here
+
+enum timing_metric_t
+{
+    timing_break = 0, //length of the break field
+    timing_header,    //falling edge of the break to the end of the PID
+    timing_delay,     //end of the PID to the start of the first response byte
+    timing_response,  //end of the PID to the end of the checksum
+    timing_gap,       //the longest space between two response bytes of the frame
+    TIMING_METRICS
+};
+
+//upper bounds of the histogram bins, the last bin takes the rest. Break, header and response in percent of
+//their nominal time (above 140 is too slow), the spaces in percent of a bit time
+const uint16_t TIMING_RATIO_EDGES[TIMING_BINS - 1] = {100, 110, 120, 130, 140, 150, 200};
+const uint16_t TIMING_SPACE_EDGES[TIMING_BINS - 1] = {100, 200, 400, 800, 1600, 3200, 6400};
+
+//min / sum / max in us and the histogram of one measurement
+struct timing_metric
+{
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum;               //a 32-bit sum of headers would wrap after some hours
+    uint16_t bins[TIMING_BINS]; //stop counting when full
+
+    static bool isRatio(uint8_t metric) { return metric != timing_delay && metric != timing_gap; }
+
+    //reference is the nominal time (ratio metrics) or the bit time, both in us * 100
+    void add(uint8_t metric, uint32_t value, uint32_t reference)
+    {
+        if (value > 0xFFFF)
+            value = 0xFFFF;
+        if (!count || value < min)
+            min = value;
+        if (value > max)
+            max = value;
+        sum += value;
+        ++count;
+        const uint16_t *edges = isRatio(metric) ? TIMING_RATIO_EDGES : TIMING_SPACE_EDGES;
+        uint32_t percent = value * 10000 / reference;
+        uint8_t bin = 0;
+        while (bin < TIMING_BINS - 1 && percent >= edges[bin])
+            ++bin;
+        if (bins[bin] != TIMING_BIN_FULL)
+            ++bins[bin];
+    }
+
+    bool binsFull() const
+    {
+        for (uint8_t bin = 0; bin < TIMING_BINS; ++bin)
+            if (bins[bin] == TIMING_BIN_FULL)
+                return true;
+        return false;
+    }
+};
+
+//timing of the frames of one id, counted by the bus
+struct id_timing
+{
+    timing_metric metrics[TIMING_METRICS];
+    uint32_t late_headers;   //longer than 1.4 times nominal
+    uint32_t late_responses; //longer than 1.4 times nominal
+    uint32_t no_response;    //headers without a response
+};
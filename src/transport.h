@@ -0,0 +1,206 @@
+#pragma once
+#include "LIN_handler.h"
+#include "binary_protocol.h"
+
+//LIN transport layer (LIN 2.x, ISO 17987-2) on the diagnostic frames. Data byte 0 is the NAD, byte 1 the PCI:
+//  0x0L - single frame, L (1..6) bytes follow
+//  0x1H - first frame, the next byte is the low byte of the 12-bit length, 5 bytes follow
+//  0x2N - consecutive frame, N is the sequence number (1 after the first frame, then counting modulo 16), 6 bytes follow
+#define TP_SINGLE_FRAME 0x0
+#define TP_FIRST_FRAME 0x1
+#define TP_CONSECUTIVE_FRAME 0x2
+#define TP_SLEEP_NAD 0x00               //a master request with NAD 0 is the go to sleep command, not a message
+#define TP_MESSAGE_DATA BIN_MAX_DIAGNOSTIC //bytes kept of a message, the rest is only counted (up to 4095)
+#define TP_TIMEOUT 1000000UL            //us a message waits for its next frame (N_Cr of LIN TP is 1000 ms)
+#define TP_MESSAGES 8                   //messages waiting for the host serial port, all buses. Has to be a power of two
+
+enum tp_status_t
+{
+    tp_complete = BIN_DIAGNOSTIC_COMPLETE,
+    tp_sequence = BIN_DIAGNOSTIC_SEQUENCE,       //a consecutive frame with the wrong sequence number or NAD, the message ends before it
+    tp_interrupted = BIN_DIAGNOSTIC_INTERRUPTED, //a new message or a damaged frame came before the last frame
+    tp_timeout = BIN_DIAGNOSTIC_TIMEOUT,         //no frame of the message for TP_TIMEOUT
+    tp_unexpected = BIN_DIAGNOSTIC_UNEXPECTED,   //a consecutive frame without a message or a PCI that is not defined: the frame
+    tp_sleep = BIN_DIAGNOSTIC_SLEEP              //the go to sleep command
+};
+
+//a diagnostic message, reassembled from the frames of one direction
+struct tp_message
+{
+    uint8_t channel;
+    uint8_t id; //LIN_MASTER_REQUEST or LIN_SLAVE_RESPONSE
+    uint8_t nad;
+    tp_status_t status;
+    uint16_t length;    //announced by the single or first frame
+    uint16_t received;  //data bytes received, data holds the first TP_MESSAGE_DATA of them
+    unsigned long time; //break of the first frame
+    uint32_t duration;  //from the break of the first frame to the break of the last one, us
+    uint32_t latency;   //slave responses: from the break of the last frame of the request, 0 - no request seen
+    uint8_t data[TP_MESSAGE_DATA];
+};
+
+//reassembles the master requests and the slave responses of one bus. Both directions carry one message at a
+//time, so a frame only appends to the message of its direction. Finished messages go to MarkMessage
+class tp_reassembler
+{
+public:
+    void (*MarkMessage)(tp_message &message) = nullptr;
+
+    void clear()
+    {
+        for (direction &d : directions)
+        {
+            d.active = false;
+            d.skipping = false;
+        }
+        request_seen = false;
+    }
+
+    //a diagnostic frame with a valid checksum
+    void frame(const data_frame &frame)
+    {
+        direction &d = directions[frame.id - LIN_MASTER_REQUEST];
+        //a header without a response, the slave is not ready yet
+        if (frame.data_count == 0)
+            return;
+        if (frame.data_count != 8)
+        {
+            damaged(frame);
+            return;
+        }
+        if (frame.id == LIN_MASTER_REQUEST && frame.data[0] == TP_SLEEP_NAD)
+        {
+            interrupt(d);
+            begin(d, frame, 0);
+            finish(d, tp_sleep);
+            return;
+        }
+        uint8_t pci = frame.data[1];
+        switch (pci >> 4)
+        {
+        case TP_SINGLE_FRAME:
+            if ((pci & 0x0F) < 1 || (pci & 0x0F) > 6)
+                break;
+            interrupt(d);
+            begin(d, frame, pci & 0x0F);
+            append(d, frame.data + 2, pci & 0x0F);
+            finish(d, tp_complete);
+            return;
+        case TP_FIRST_FRAME:
+        {
+            uint16_t length = (pci & 0x0F) << 8 | frame.data[2];
+            if (length < 7) //fits a single frame
+                break;
+            interrupt(d);
+            begin(d, frame, length);
+            append(d, frame.data + 3, 5);
+            d.sequence = 1;
+            d.active = true;
+            return;
+        }
+        case TP_CONSECUTIVE_FRAME:
+            //the rest of a message that was cut or started before the sniffer
+            if (!d.active && d.skipping)
+                return;
+            if (!d.active)
+                break;
+            if ((pci & 0x0F) != d.sequence || frame.data[0] != d.message.nad)
+            {
+                finish(d, tp_sequence);
+                d.skipping = true;
+                return;
+            }
+            d.sequence = (d.sequence + 1) & 0x0F;
+            d.last = frame.time;
+            append(d, frame.data + 2, d.message.length - d.message.received < 6 ? d.message.length - d.message.received : 6);
+            if (d.message.received == d.message.length)
+                finish(d, tp_complete);
+            return;
+        }
+        //reported as it is, the rest of its message is not
+        interrupt(d);
+        begin(d, frame, 8);
+        append(d, frame.data, 8);
+        finish(d, tp_unexpected);
+        d.skipping = true;
+    }
+
+    //a diagnostic frame with a wrong checksum or too short: the message it belongs to can not be completed.
+    //If it was the first frame, its consecutive frames are ignored - the frame itself is reported as an error
+    void damaged(const data_frame &frame)
+    {
+        direction &d = directions[frame.id - LIN_MASTER_REQUEST];
+        if (d.active)
+        {
+            d.last = frame.time;
+            finish(d, tp_interrupted);
+        }
+        d.skipping = true;
+    }
+
+    //ends the messages whose next frame did not come in time, called from loop()
+    void poll(unsigned long now)
+    {
+        for (direction &d : directions)
+            if (d.active && now - d.last > TP_TIMEOUT)
+            {
+                finish(d, tp_timeout);
+                d.skipping = true;
+            }
+    }
+
+private:
+    struct direction
+    {
+        tp_message message;
+        bool active;       //a first frame was received, the message waits for its consecutive frames
+        bool skipping;     //the message was cut, its consecutive frames are ignored
+        uint8_t sequence;  //of the next consecutive frame
+        unsigned long last; //break of the last frame of the message
+    };
+
+    void begin(direction &d, const data_frame &frame, uint16_t length)
+    {
+        d.message.channel = frame.channel;
+        d.message.id = frame.id;
+        d.message.nad = frame.data[0];
+        d.message.length = length;
+        d.message.received = 0;
+        d.message.time = frame.time;
+        d.message.latency = frame.id == LIN_SLAVE_RESPONSE && request_seen ? frame.time - request_end : 0;
+        d.last = frame.time;
+        d.skipping = false;
+    }
+
+    void append(direction &d, const uint8_t *bytes, uint8_t count)
+    {
+        for (uint8_t i = 0; i < count; ++i, ++d.message.received)
+            if (d.message.received < TP_MESSAGE_DATA)
+                d.message.data[d.message.received] = bytes[i];
+    }
+
+    //a new message starts before the last one got all of its frames
+    void interrupt(direction &d)
+    {
+        if (d.active)
+            finish(d, tp_interrupted);
+    }
+
+    void finish(direction &d, tp_status_t status)
+    {
+        d.active = false;
+        d.message.status = status;
+        d.message.duration = d.last - d.message.time;
+        if (d.message.id == LIN_MASTER_REQUEST && status == tp_complete)
+        {
+            request_seen = true;
+            request_end = d.last;
+        }
+        if (MarkMessage)
+            MarkMessage(d.message);
+    }
+
+    direction directions[2] = {}; //master request, slave response
+    bool request_seen = false;
+    unsigned long request_end; //break of the last frame of the last complete request
+};
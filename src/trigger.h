@@ -0,0 +1,246 @@
+#pragma once
+#include "LIN_handler.h"
+
+#define CAPTURE_SIZE 256          //frames kept for the dumps, 20 bytes each (5 KB). Has to be a power of two
+#define TRIGGER_COUNT 8           //triggers that can be set at once
+#define TRIGGER_DEFAULT_FRAMES 16 //frames dumped before and after a trigger
+#define TRIGGER_ANY_ID LIN_MEM_SIZE
+#define TRIGGER_NO_BYTE 0xFF
+
+static_assert((CAPTURE_SIZE & (CAPTURE_SIZE - 1)) == 0, "CAPTURE_SIZE must be a power of two");
+
+//a frame in the capture ring
+struct captured_frame
+{
+    uint32_t time;
+    uint8_t channel;
+    uint8_t id;
+    uint8_t data_count;
+    uint8_t status; //frame_status_t
+    uint8_t data[8];
+    uint8_t chk;
+};
+
+enum trigger_kind_t
+{
+    trigger_none = 0,
+    trigger_match,  //a frame of the id, optionally with (data byte & mask) == value
+    trigger_error,  //a frame with a parity or checksum error, of the id or any id
+    trigger_missing //no frame of the id for longer than the timeout
+};
+
+struct trigger_t
+{
+    trigger_kind_t kind;
+    uint8_t channel; //0 - any bus
+    uint8_t id;      //TRIGGER_ANY_ID - any id (error triggers only)
+    uint8_t byte;    //match: index of the data byte, TRIGGER_NO_BYTE - every frame of the id
+    uint8_t mask;
+    uint8_t value;
+    uint32_t timeout;        //missing: us
+    unsigned long last_seen; //missing: time of the last frame of the id
+    bool armed;              //missing: false after it fired, until the id is seen again
+};
+
+//what the dump sends next
+enum dump_step_t
+{
+    dump_idle = 0,
+    dump_marker, //the trigger fired, the frames follow
+    dump_frame,
+    dump_finished
+};
+
+//records every frame into a ring and checks it against the triggers. When one fires, the frames before it
+//(already in the ring) and after it (still to come) are dumped - the output only reads them from the ring,
+//so nothing is copied and a slow host port only loses the frames the ring has overwritten in the meantime
+class trigger_engine
+{
+public:
+    bool active() const { return count != 0; }
+
+    //adds a trigger, returns its number (from 1) or 0 if all are in use
+    uint8_t add(const trigger_t &trigger)
+    {
+        for (uint8_t i = 0; i < TRIGGER_COUNT; ++i)
+        {
+            if (triggers[i].kind != trigger_none)
+                continue;
+            triggers[i] = trigger;
+            triggers[i].last_seen = hal::timestamp();
+            triggers[i].armed = true;
+            ++count;
+            updateWatched();
+            return i + 1;
+        }
+        return 0;
+    }
+
+    void clear()
+    {
+        memset(triggers, 0, sizeof(triggers));
+        count = 0;
+        updateWatched();
+        dumping = false;
+        marker_pending = false;
+    }
+
+    const trigger_t &trigger(uint8_t index) const { return triggers[index]; }
+
+    //records the frame, checks the triggers
+    void capture(const data_frame &frame)
+    {
+        captured_frame &slot = ring[written & (CAPTURE_SIZE - 1)];
+        slot.time = frame.time;
+        slot.channel = frame.channel;
+        slot.id = frame.id;
+        slot.data_count = frame.data_count;
+        slot.status = frame.status;
+        memcpy(slot.data, frame.data, sizeof(slot.data));
+        slot.chk = frame.chk;
+        ++written;
+        //most frames are of no interest to any trigger
+        if (!(watched & LIN_ID_BIT(frame.id)) && !(any_error && frame.status != frame_valid))
+            return;
+        for (uint8_t i = 0; i < TRIGGER_COUNT; ++i)
+        {
+            trigger_t &t = triggers[i];
+            if (t.kind == trigger_none || (t.channel && t.channel != frame.channel))
+                continue;
+            if (t.id != frame.id && t.id != TRIGGER_ANY_ID)
+                continue;
+            bool fires = false;
+            switch (t.kind)
+            {
+            case trigger_match:
+                fires = frame.status == frame_valid &&
+                        (t.byte == TRIGGER_NO_BYTE || (t.byte < frame.data_count && (frame.data[t.byte] & t.mask) == t.value));
+                break;
+            case trigger_error:
+                fires = frame.status != frame_valid;
+                break;
+            case trigger_missing:
+                if (frame.status == frame_valid)
+                {
+                    t.last_seen = frame.time;
+                    t.armed = true;
+                }
+                break;
+            default:
+                break;
+            }
+            if (fires)
+                fire(i, written - 1, true, frame.channel, frame.time);
+        }
+    }
+
+    //checks the missing triggers, called from loop()
+    void poll(unsigned long now)
+    {
+        if (!missing)
+            return;
+        for (uint8_t i = 0; i < TRIGGER_COUNT; ++i)
+        {
+            trigger_t &t = triggers[i];
+            if (t.kind != trigger_missing || !t.armed || now - t.last_seen <= t.timeout)
+                continue;
+            t.armed = false;
+            //no frame caused it, the frames after are the ones to come
+            fire(i, written, false, t.channel, now);
+        }
+    }
+
+    //the next thing to send of the dump, frame is set for dump_frame
+    dump_step_t next(captured_frame &frame, bool &fired_frame)
+    {
+        if (marker_pending)
+        {
+            marker_pending = false;
+            return dump_marker;
+        }
+        if (!dumping)
+            return dump_idle;
+        if ((int32_t)(dump_end - dump_next) <= 0)
+        {
+            dumping = false;
+            return dump_finished;
+        }
+        if (dump_next == written)
+            return dump_idle; //waiting for the frames after the trigger
+        //the host port was too slow, the ring has been written over
+        if (written - dump_next > CAPTURE_SIZE)
+        {
+            lost += written - CAPTURE_SIZE - dump_next;
+            dump_next = written - CAPTURE_SIZE;
+        }
+        frame = ring[dump_next & (CAPTURE_SIZE - 1)];
+        fired_frame = has_fired_frame && dump_next == fired_seq;
+        ++dump_next;
+        return dump_frame;
+    }
+
+    uint16_t before = TRIGGER_DEFAULT_FRAMES; //frames dumped before the trigger
+    uint16_t after = TRIGGER_DEFAULT_FRAMES;  //frames dumped after the trigger
+    uint32_t lost = 0;                        //frames of this dump the ring had written over before they were sent
+    uint32_t ignored = 0;                     //triggers that fired while a dump was still going on
+    //the trigger being dumped
+    uint8_t fired_trigger; //number, from 1
+    uint8_t fired_channel; //0 - any bus (missing trigger without a channel)
+    unsigned long fired_time;
+
+private:
+    void fire(uint8_t index, uint32_t seq, bool frame, uint8_t channel, unsigned long time)
+    {
+        if (dumping || marker_pending)
+        {
+            ++ignored;
+            return;
+        }
+        fired_trigger = index + 1;
+        fired_channel = channel;
+        fired_time = time;
+        fired_seq = seq;
+        has_fired_frame = frame;
+        lost = 0;
+        //only what is still in the ring can be dumped
+        uint32_t available = written < CAPTURE_SIZE ? written : CAPTURE_SIZE;
+        uint32_t previous = seq - (written - available);
+        dump_next = seq - (before < previous ? before : previous);
+        dump_end = seq + after + (frame ? 1 : 0);
+        dumping = true;
+        marker_pending = true;
+    }
+
+    void updateWatched()
+    {
+        watched = 0;
+        any_error = false;
+        missing = false;
+        for (uint8_t i = 0; i < TRIGGER_COUNT; ++i)
+        {
+            const trigger_t &t = triggers[i];
+            if (t.kind == trigger_none)
+                continue;
+            if (t.id == TRIGGER_ANY_ID)
+                any_error = true;
+            else
+                watched |= LIN_ID_BIT(t.id);
+            missing |= t.kind == trigger_missing;
+        }
+    }
+
+    captured_frame ring[CAPTURE_SIZE];
+    uint32_t written = 0; //frames recorded so far, the next one goes to written % CAPTURE_SIZE
+    trigger_t triggers[TRIGGER_COUNT] = {};
+    uint8_t count = 0;
+    uint64_t watched = 0;   //ids some trigger is interested in
+    bool any_error = false; //an error trigger for any id is set
+    bool missing = false;   //a missing trigger is set
+    //dump
+    bool dumping = false;
+    bool marker_pending = false;
+    uint32_t dump_next;
+    uint32_t dump_end;
+    uint32_t fired_seq;
+    bool has_fired_frame;
+};
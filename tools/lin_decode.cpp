@@ -0,0 +1,284 @@
+//decodes the binary output of the sniffer to text or CSV
+//Usage: lin_decode [-f text|csv] [file]
+//Reads the file (e.g. the serial port device) or the standard input.
+//Build: g++ -std=c++11 -O2 -o lin_decode tools/lin_decode.cpp
+#include "lin_stream.h"
+#include <stdio.h>
+
+namespace
+{
+    bool csv = false;
+    uint32_t stats_period_ms; //of the last record_stats, the bus records that follow belong to it
+    bool dump = false;        //between the records of a fired trigger and the end of its dump
+
+    void printRecord(const lin_record &record, void *)
+    {
+        if (record.type == record_new_loop)
+        {
+            if (csv)
+                printf("%u,%u,loop,,%u,,,\n", record.time, record.channel, record.loop_frames);
+            else
+                printf("%10u %u:NL: %u frames\n", record.time, record.channel, record.loop_frames);
+            return;
+        }
+        if (record.type == record_drops)
+        {
+            //the sniffer could not send everything, frames are missing before this point
+            fprintf(stderr, "output overflow - dropped: %u, coalesced: %u\n", record.dropped, record.coalesced);
+            return;
+        }
+        //statistics go to stderr in CSV mode, like the messages of the sniffer
+        if (record.type == record_stats)
+        {
+            stats_period_ms = record.period_ms;
+            fprintf(csv ? stderr : stdout, "ST: period_ms=%u loop_max_us=%.1f callbacks_pct=%.1f callback_max_us=%.1f queue_high_water=%u\n",
+                    record.period_ms, record.max_loop_ns / 1000.0, record.callback_permille / 10.0, record.max_callback_ns / 1000.0, record.high_water);
+            return;
+        }
+        if (record.type == record_bus_stats)
+        {
+            double seconds = stats_period_ms ? stats_period_ms / 1000.0 : 1;
+            fprintf(csv ? stderr : stdout, "ST: channel=%u frames=%u fps=%.1f load_pct=%.1f glitches=%u dropped=%u\n",
+                    record.channel, record.frames, record.frames / seconds, record.load_permille / 10.0, record.glitches, record.dropped_frames);
+            return;
+        }
+        if (record.type == record_trigger)
+        {
+            dump = record.trigger_event == BIN_TRIGGER_FIRED;
+            if (csv)
+                printf("%u,%u,%s,%u,,,,\n", record.time, record.channel, dump ? "trigger" : "trigger_end", record.trigger);
+            else if (dump)
+                printf("%10u TR: trigger %u fired\n", record.time, record.trigger);
+            else if (record.lost)
+                printf("TR: end of capture, %u frames lost\n", record.lost);
+            else
+                printf("TR: end of capture\n");
+            return;
+        }
+        if (record.type == record_schedule)
+        {
+            static const char *const events[] = {"", "learned", "switched", "missing", "extra", "jitter", "lost"};
+            const char *event = record.schedule_event <= BIN_SCHEDULE_LOST ? events[record.schedule_event] : "unknown";
+            if (csv)
+            {
+                printf("%u,%u,schedule_%s,%02x,%u,table=%u slot=%u measured=%u expected=%u,,\n", record.time, record.channel, event,
+                       record.id, record.count, record.table, record.slot, record.measured, record.expected);
+                return;
+            }
+            printf("%10u %u:SC: ", record.time, record.channel);
+            switch (record.schedule_event)
+            {
+            case BIN_SCHEDULE_LEARNED:
+                printf("table %u learned, %u slots, cycle %u us\n", record.table, record.count, record.expected);
+                break;
+            case BIN_SCHEDULE_SWITCHED:
+                printf("switched to table %u\n", record.table);
+                break;
+            case BIN_SCHEDULE_MISSING:
+                printf("%u slots missing from slot %u (id %02x)\n", record.count, record.slot, record.id);
+                break;
+            case BIN_SCHEDULE_EXTRA:
+                printf("extra frame %02x\n", record.id);
+                break;
+            case BIN_SCHEDULE_JITTER:
+                printf("slot %u (id %02x) %u us after the slot before, expected %u us\n", record.slot, record.id, record.measured, record.expected);
+                break;
+            default:
+                if (record.measured)
+                    printf("no frames for %u us, ", record.measured);
+                printf("schedule %s\n", event);
+                break;
+            }
+            return;
+        }
+        if (record.type == record_diagnostic)
+        {
+            static const char *const statuses[] = {"complete", "sequence error", "interrupted", "timeout", "unexpected frame", "go to sleep"};
+            const char *status = record.diagnostic_status <= BIN_DIAGNOSTIC_SLEEP ? statuses[record.diagnostic_status] : "unknown";
+            const char *direction = record.id == 0x3C ? "req" : "rsp";
+            if (csv)
+            {
+                printf("%u,%u,diag_%s,%02x,%u,", record.time, record.channel, direction, record.id, record.received);
+                for (int i = 0; i < record.data_count; ++i)
+                    printf("%02x", record.message[i]);
+                printf(",,nad=%02x length=%u duration=%u latency=%u %s\n", record.nad, record.length, record.duration, record.latency, status);
+                return;
+            }
+            printf("%10u %u:DG %s %02x", record.time, record.channel, direction, record.nad);
+            if (record.diagnostic_status == BIN_DIAGNOSTIC_SLEEP)
+            {
+                printf(" go to sleep\n");
+                return;
+            }
+            printf(" |");
+            for (int i = 0; i < record.data_count; ++i)
+                printf(" %02x", record.message[i]);
+            if (record.diagnostic_status == BIN_DIAGNOSTIC_UNEXPECTED)
+                printf(" | %s", status);
+            else if (record.diagnostic_status == BIN_DIAGNOSTIC_COMPLETE)
+                printf(" | %u bytes", record.length);
+            else
+                printf(" | %u of %u bytes, %s", record.received, record.length, status);
+            if (record.data_count < record.received)
+                printf(" (first %u shown)", record.data_count);
+            if (record.duration)
+                printf(", %u us", record.duration);
+            if (record.latency)
+                printf(", %u us after the request", record.latency);
+            printf("\n");
+            return;
+        }
+        if (record.type == record_malformed)
+        {
+            static const char *const kinds[] = {"no PID", "header only", "truncated", "over-length", "framing error", "short break"};
+            int count = record.byte_count < 11 ? record.byte_count : 11;
+            if (csv)
+                printf("%u,%u,malformed,,%u,", record.time, record.channel, record.byte_count);
+            else
+                printf("%10u %u:MF: ", record.time, record.channel);
+            bool first = true;
+            for (int kind = 0; kind < 6; ++kind)
+                if (record.kinds & (1 << kind))
+                {
+                    //the CSV data column holds the raw bytes, the kinds go to the flags column
+                    if (!csv)
+                        printf("%s%s", first ? "" : ", ", kinds[kind]);
+                    first = false;
+                }
+            if (csv)
+            {
+                for (int i = 0; i < count; ++i)
+                    printf("%02x", record.bytes[i]);
+                printf(",,%02x\n", record.kinds);
+                return;
+            }
+            printf(" |");
+            for (int i = 0; i < count; ++i)
+                printf(" %02x", record.bytes[i]);
+            if (count < record.byte_count)
+                printf(" +%u", record.byte_count - count);
+            printf(" | break %u us\n", record.break_length);
+            return;
+        }
+        if (record.type == record_suppressed)
+        {
+            if (csv)
+                printf("%u,%u,suppressed,%02x,%u,,,\n", record.time, record.channel, record.id, record.suppressed);
+            else
+                printf("%10u %u:%02x | x%u suppressed\n", record.time, record.channel, record.id, record.suppressed);
+            return;
+        }
+        if (record.type == record_history)
+        {
+            if (!record.channel)
+            {
+                //the end goes with the command replies
+                fprintf(csv ? stderr : stdout, "HI: end of history, %u payloads\n", record.repeats);
+                return;
+            }
+            if (csv)
+            {
+                printf("%u,%u,history,%02x,%u,", record.time, record.channel, record.id, record.data_count);
+                for (int i = 0; i < record.data_count; ++i)
+                    printf("%02x", record.data[i]);
+                printf(",,repeats=%u\n", record.repeats);
+                return;
+            }
+            printf("%10u %u:%02x | ", record.time, record.channel, record.id);
+            for (int i = 0; i < record.data_count; ++i)
+                printf("%02x ", record.data[i]);
+            printf("| x%u\n", record.repeats);
+            return;
+        }
+        //signal numbers, the names are in the sniffer's 'signal list'
+        if (record.type == record_signals)
+        {
+            if (csv)
+            {
+                printf("%u,%u,signals,%02x,%u,", record.time, record.channel, record.id, record.signal_count);
+                for (int i = 0; i < record.signal_count; ++i)
+                    printf("%s%u=%g", i ? " " : "", record.signal[i], record.value[i]);
+                printf(",,\n");
+            }
+            else
+            {
+                printf("%10u %u:%02x :", record.time, record.channel, record.id);
+                for (int i = 0; i < record.signal_count; ++i)
+                    printf(" #%u=%g", record.signal[i], record.value[i]);
+                printf("\n");
+            }
+            return;
+        }
+        const char *kind = (record.flags & BIN_FLAG_PARITY_ERROR) ? "parity error" : (record.flags & BIN_FLAG_CHECKSUM_ERROR) ? "checksum error"
+                         : (record.flags & BIN_FLAG_TRIGGER)      ? "trigger"
+                         : dump                                   ? "captured"
+                         : (record.flags & BIN_FLAG_NEW)          ? "new"
+                         : (record.flags & BIN_FLAG_CHANGED)      ? "changed"
+                                                                  : "unchanged";
+        if (csv)
+        {
+            printf("%u,%u,%s,%02x,%u,", record.time, record.channel, kind, record.id, record.data_count);
+            for (int i = 0; i < record.data_count; ++i)
+                printf("%02x", record.data[i]);
+            printf(",%02x,%02x\n", record.chk, record.flags);
+        }
+        else
+        {
+            printf("%10u %u:%02x | ", record.time, record.channel, record.id);
+            for (int i = 0; i < record.data_count; ++i)
+                printf("%02x ", record.data[i]);
+            printf("(%02x) %s\n", record.chk, kind);
+        }
+    }
+
+    void printText(const std::string &text, void *)
+    {
+        //messages of the sniffer go to stderr, so the CSV stays clean
+        fputs(text.c_str(), csv ? stderr : stdout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; ++i)
+    {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc)
+        {
+            ++i;
+            csv = !strcmp(argv[i], "csv");
+            usage = !csv && strcmp(argv[i], "text");
+        }
+        else if (!path && argv[i][0] != '-')
+            path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage)
+    {
+        fprintf(stderr, "usage: lin_decode [-f text|csv] [file]\n");
+        return 1;
+    }
+
+    FILE *in = path ? fopen(path, "rb") : stdin;
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    if (csv)
+        printf("time_us,channel,type,id,data_count,data,chk,flags\n");
+
+    lin_stream stream(printRecord, printText);
+    uint8_t buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+        stream.feed(buffer, length);
+        fflush(stdout);
+    }
+    if (stream.bad_blocks)
+        fprintf(stderr, "%llu damaged records skipped\n", (unsigned long long)stream.bad_blocks);
+    return 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+//host side decoder of the sniffer's binary output (see src/binary_protocol.h)
+//Feed it the bytes read from the serial port; complete records and text messages are passed to the handlers.
+#include "../src/binary_protocol.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct lin_record
+{
+    record_type_t type;
+    uint8_t flags;
+    uint8_t channel; //LIN port of record_frame and record_new_loop
+    uint8_t id;
+    uint8_t data_count;
+    uint8_t data[8];
+    uint8_t chk;
+    uint8_t loop_frames; //record_new_loop: number of frames in the finished loop
+    uint32_t time;       //us
+    uint32_t dropped;    //record_drops: reports the sniffer dropped since the last record_drops
+    uint32_t coalesced;  //record_drops: frames the sniffer merged since the last record_drops
+    //record_stats
+    uint32_t period_ms;
+    uint32_t max_loop_ns;
+    uint16_t callback_permille;
+    uint32_t max_callback_ns;
+    uint16_t high_water;
+    //record_bus_stats (with channel)
+    uint32_t frames;
+    uint16_t load_permille;
+    uint32_t glitches;
+    uint32_t dropped_frames;
+    //record_trigger (with channel and time)
+    uint8_t trigger_event; //BIN_TRIGGER_FIRED or BIN_TRIGGER_END
+    uint8_t trigger;
+    uint16_t lost;
+    //record_signals (with channel, id and time)
+    uint8_t signal_count;
+    uint8_t signal[BIN_MAX_SIGNALS]; //number in the sniffer's 'signal list'
+    float value[BIN_MAX_SIGNALS];    //physical value
+    //record_schedule (with channel, id and time)
+    uint8_t schedule_event; //BIN_SCHEDULE_...
+    uint8_t table;
+    uint8_t slot;
+    uint8_t count;
+    uint32_t measured; //us
+    uint32_t expected; //us
+    //record_diagnostic (with channel, id, time and data count)
+    uint8_t diagnostic_status; //BIN_DIAGNOSTIC_...
+    uint8_t nad;
+    uint16_t length;   //announced
+    uint16_t received; //the first data count of them are in message
+    uint32_t duration; //us
+    uint32_t latency;  //us after the request, 0 - none
+    uint8_t message[BIN_MAX_DIAGNOSTIC];
+    //record_malformed (with channel and time)
+    uint8_t kinds;      //bit 0 no PID, 1 header only, 2 truncated, 3 over-length, 4 framing error, 5 short break
+    uint8_t byte_count; //received, the first (up to 11) are in bytes
+    uint32_t break_length; //us
+    uint8_t bytes[11];  //sync, PID, response
+    //record_suppressed (with channel, id and time of the last frame held back)
+    uint32_t suppressed; //frames held back by the limit of the id
+    //record_history (with channel, id, time of the first frame, data count and data). Channel 0 ends the history
+    uint32_t repeats; //frames in a row with the payload, at the end the number of payloads sent
+};
+
+class lin_stream
+{
+public:
+    typedef void (*record_handler)(const lin_record &record, void *context);
+    typedef void (*text_handler)(const std::string &text, void *context);
+
+    lin_stream(record_handler _on_record, text_handler _on_text, void *_context = nullptr)
+        : on_record(_on_record), on_text(_on_text), context(_context) {}
+
+    void feed(const uint8_t *data, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (data[i] != BIN_DELIMITER)
+            {
+                block.push_back(data[i]);
+                continue;
+            }
+            if (!block.empty())
+                finishBlock();
+            block.clear();
+        }
+    }
+
+    uint64_t records = 0;    //records decoded
+    uint64_t bad_blocks = 0; //blocks that were neither a record nor text
+
+private:
+    void finishBlock()
+    {
+        uint8_t raw[BIN_MAX_RECORD];
+        size_t length = binary_protocol::decode(block.data(), block.size(), raw, sizeof(raw));
+        lin_record record;
+        if (length >= 2 && binary_protocol::crc8(raw, length - 1) == raw[length - 1] && parse(raw, length - 1, record))
+        {
+            ++records;
+            if (on_record)
+                on_record(record, context);
+            return;
+        }
+        //command replies and messages printed between records
+        bool printable = true;
+        for (uint8_t c : block)
+            printable &= (c >= 0x20 && c < 0x7F) || c == '\r' || c == '\n' || c == '\t' || c == 0x1B;
+        if (printable)
+        {
+            if (on_text)
+                on_text(std::string(block.begin(), block.end()), context);
+        }
+        else
+            ++bad_blocks;
+    }
+
+    static bool parse(const uint8_t *raw, size_t length, lin_record &record)
+    {
+        memset(&record, 0, sizeof(record));
+        record.type = (record_type_t)raw[0];
+        switch (record.type)
+        {
+        case record_frame:
+            if (length < 10 || raw[4] > 8 || length != 10u + raw[4])
+                return false;
+            record.flags = raw[1];
+            record.channel = raw[2];
+            record.id = raw[3];
+            record.data_count = raw[4];
+            record.time = binary_protocol::getU32(raw + 5);
+            memcpy(record.data, raw + 9, record.data_count);
+            record.chk = raw[9 + record.data_count];
+            return true;
+        case record_new_loop:
+            if (length != 7)
+                return false;
+            record.channel = raw[1];
+            record.loop_frames = raw[2];
+            record.time = binary_protocol::getU32(raw + 3);
+            return true;
+        case record_drops:
+            if (length != 9)
+                return false;
+            record.dropped = binary_protocol::getU32(raw + 1);
+            record.coalesced = binary_protocol::getU32(raw + 5);
+            return true;
+        case record_stats:
+            if (length != 17)
+                return false;
+            record.period_ms = binary_protocol::getU32(raw + 1);
+            record.max_loop_ns = binary_protocol::getU32(raw + 5);
+            record.callback_permille = binary_protocol::getU16(raw + 9);
+            record.max_callback_ns = binary_protocol::getU32(raw + 11);
+            record.high_water = binary_protocol::getU16(raw + 15);
+            return true;
+        case record_bus_stats:
+            if (length != 16)
+                return false;
+            record.channel = raw[1];
+            record.frames = binary_protocol::getU32(raw + 2);
+            record.load_permille = binary_protocol::getU16(raw + 6);
+            record.glitches = binary_protocol::getU32(raw + 8);
+            record.dropped_frames = binary_protocol::getU32(raw + 12);
+            return true;
+        case record_trigger:
+            if (length != 10)
+                return false;
+            record.trigger_event = raw[1];
+            record.trigger = raw[2];
+            record.channel = raw[3];
+            record.time = binary_protocol::getU32(raw + 4);
+            record.lost = binary_protocol::getU16(raw + 8);
+            return true;
+        case record_signals:
+            if (length < 8 || raw[7] > BIN_MAX_SIGNALS || length != 8u + 5 * raw[7])
+                return false;
+            record.channel = raw[1];
+            record.id = raw[2];
+            record.time = binary_protocol::getU32(raw + 3);
+            record.signal_count = raw[7];
+            for (uint8_t i = 0; i < record.signal_count; ++i)
+            {
+                record.signal[i] = raw[8 + 5 * i];
+                record.value[i] = binary_protocol::getFloat(raw + 9 + 5 * i);
+            }
+            return true;
+        case record_schedule:
+            if (length != 19)
+                return false;
+            record.schedule_event = raw[1];
+            record.channel = raw[2];
+            record.table = raw[3];
+            record.slot = raw[4];
+            record.id = raw[5];
+            record.count = raw[6];
+            record.time = binary_protocol::getU32(raw + 7);
+            record.measured = binary_protocol::getU32(raw + 11);
+            record.expected = binary_protocol::getU32(raw + 15);
+            return true;
+        case record_diagnostic:
+            if (length < 22 || raw[21] > BIN_MAX_DIAGNOSTIC || length != 22u + raw[21])
+                return false;
+            record.diagnostic_status = raw[1];
+            record.channel = raw[2];
+            record.id = raw[3];
+            record.nad = raw[4];
+            record.length = binary_protocol::getU16(raw + 5);
+            record.received = binary_protocol::getU16(raw + 7);
+            record.time = binary_protocol::getU32(raw + 9);
+            record.duration = binary_protocol::getU32(raw + 13);
+            record.latency = binary_protocol::getU32(raw + 17);
+            record.data_count = raw[21];
+            memcpy(record.message, raw + 22, record.data_count);
+            return true;
+        case record_malformed:
+            if (length < 12 || length != 12u + (raw[3] < 11 ? raw[3] : 11))
+                return false;
+            record.channel = raw[1];
+            record.kinds = raw[2];
+            record.byte_count = raw[3];
+            record.time = binary_protocol::getU32(raw + 4);
+            record.break_length = binary_protocol::getU32(raw + 8);
+            memcpy(record.bytes, raw + 12, length - 12);
+            return true;
+        case record_suppressed:
+            if (length != 11)
+                return false;
+            record.channel = raw[1];
+            record.id = raw[2];
+            record.suppressed = binary_protocol::getU32(raw + 3);
+            record.time = binary_protocol::getU32(raw + 7);
+            return true;
+        case record_history:
+            if (length < 12 || raw[3] > 8 || length != 12u + raw[3])
+                return false;
+            record.channel = raw[1];
+            record.id = raw[2];
+            record.data_count = raw[3];
+            record.time = binary_protocol::getU32(raw + 4);
+            record.repeats = binary_protocol::getU32(raw + 8);
+            memcpy(record.data, raw + 12, record.data_count);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    record_handler on_record;
+    text_handler on_text;
+    void *context;
+    std::vector<uint8_t> block;
+};